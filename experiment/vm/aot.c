@@ -0,0 +1,622 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <math.h>
+#include "types.h"
+#include "memory.h"
+#include "gc.h"
+#include "utf8.h"
+#include "view.h"
+#include "sort.h"
+#include "search.h"
+#include "replicate.h"
+#include "apply.h"
+#include "arith.h"
+#include "aot.h"
+
+// never freed: the count can't reach zero
+Arr aot_nothing_arr = { .refc = (u64)1<<62, .type = el_arr };
+Arr aot_skip_arr    = { .refc = (u64)1<<62, .type = el_arr };
+
+static Val *consts;
+static Val result;
+static jmp_buf *on_error;
+static char err_msg[256];
+static i64 err_start = -1, err_end = -1;
+static i32 err_unsupported;
+
+void aot_error(AotFrame *f, const char *msg) {
+    snprintf(err_msg, sizeof err_msg, "%s", msg);
+    err_start = f->p->start[f->at];
+    err_end   = f->p->end[f->at];
+    longjmp(*on_error, 1);
+}
+
+static void unsupported(AotFrame *f, const char *msg) {
+    err_unsupported = 1;
+    aot_error(f, msg);
+}
+
+/*
+ * Constants
+ */
+static Val atom(u8 type) { return val_arr(arr_new(type, 0, NULL)); }
+
+Val aot_num(f64 x) { Val v = atom(el_f64); *(f64*)val_as_arr(v)->data = x; return v; }
+Val aot_chr(u32 c) { Val v = atom(el_c32); *(u32*)val_as_arr(v)->data = c; return v; }
+
+Val aot_str(u64 n, const u32 *c) {
+    Arr *a = arr_vec(el_c32, n);
+    if (n) memcpy(a->data, c, n*sizeof(u32));
+    return val_arr(a);
+}
+
+Val aot_prim(u32 glyph) { return val_obj(obj_new(obj_prim, NULL, glyph, 0)); }
+
+Val aot_const(AotFrame *f, u32 i) { (void)f; val_inc(consts[i]); return consts[i]; }
+
+/*
+ * Arrays
+ */
+static int is_num(Val v) { return v && val_is_arr(v) && val_as_arr(v)->type <= el_f64; }
+static int is_chr(Val v) {
+    if (!v || !val_is_arr(v)) return 0;
+    u8 t = val_as_arr(v)->type;
+    return t >= el_c8 && t <= el_c32;
+}
+
+// element i of a numeric or character array as f64
+static f64 num_at(const Arr *a, ux i) {
+    switch (a->type) {
+        case el_bit: return ((const u64*)a->data)[i/64] >> (i%64) & 1;
+        case el_i8:  return ((const i8 *)a->data)[i];
+        case el_i16: return ((const i16*)a->data)[i];
+        case el_i32: return ((const i32*)a->data)[i];
+        case el_f64: return ((const f64*)a->data)[i];
+        case el_c8:  return ((const u8 *)a->data)[i];
+        case el_c16: return ((const u16*)a->data)[i];
+        default:     return ((const u32*)a->data)[i];
+    }
+}
+
+static int same_shape(const Arr *a, const Arr *b) {
+    return a->rank == b->rank && (!a->rank || !memcmp(a->sh, b->sh, a->rank*sizeof(ux)));
+}
+
+Val aot_list(AotFrame *f, u32 n, Val *v) {
+    int num = 1, chr = 1, arr = 1;
+    for (u32 i=0; i<n; i++) {
+        int atom = val_is_arr(v[i]) && val_as_arr(v[i])->rank == 0;
+        num &= atom && is_num(v[i]);
+        chr &= atom && is_chr(v[i]);
+        arr &= val_is_arr(v[i]) && v[i] != AOT_NOTHING;
+    }
+    Arr *r = NULL;
+    if (num || chr) {
+        r = arr_vec(num ? el_f64 : el_c32, n);
+        for (u32 i=0; i<n; i++) {
+            f64 x = num_at(val_as_arr(v[i]), 0);
+            if (num) ((f64*)r->data)[i] = x; else ((u32*)r->data)[i] = x;
+            val_dec(v[i]);
+        }
+    } else if (arr) {
+        r = arr_vec(el_arr, n);
+        for (u32 i=0; i<n; i++) ((Arr**)r->data)[i] = val_as_arr(v[i]);
+    } else {
+        aot_error(f, "Lists of functions aren't supported natively");
+    }
+    return val_arr(r);
+}
+
+/*
+ * Primitives
+ * Arithmetic maps over numbers, an atom pairing with every element.
+ */
+static const u32 monadic_arith[] = U"+-×÷⌊⌈|¬";
+static const u32 dyadic_arith[]  = U"+-×÷⌊⌈|¬=≠<>≤≥∧∨";
+
+static f64 arith1(u32 g, f64 x) {
+    switch (g) {
+        case U'+': return x;
+        case U'-': return -x;
+        case U'×': return (x>0) - (x<0);
+        case U'÷': return 1/x;
+        case U'⌊': return floor(x);
+        case U'⌈': return ceil(x);
+        case U'|': return fabs(x);
+        default:   return 1-x;  // ¬
+    }
+}
+
+static f64 arith2(u32 g, f64 w, f64 x) {
+    switch (g) {
+        case U'+': return w+x;
+        case U'-': return w-x;
+        case U'×': case U'∧': return w*x;
+        case U'÷': return w/x;
+        case U'⌊': return w<x ? w : x;
+        case U'⌈': return w>x ? w : x;
+        case U'|': { f64 m = fmod(x, w); return m && (m<0) != (w<0) ? m+w : m; }
+        case U'¬': return 1+w-x;
+        case U'=': return w==x;
+        case U'≠': return w!=x;
+        case U'<': return w<x;
+        case U'>': return w>x;
+        case U'≤': return w<=x;
+        case U'≥': return w>=x;
+        default:   return w+x-w*x;  // ∨
+    }
+}
+
+static int has(const u32 *s, u32 c) { for (; *s; s++) if (*s == c) return 1; return 0; }
+
+static void glyph_error(AotFrame *f, u32 g, const char *what, int unsup) {
+    u8 c[5] = {0};
+    utf32_to_utf8(&g, 1, c);
+    char m[128];
+    snprintf(m, sizeof m, "%s: %s", (char*)c, what);
+    if (unsup) unsupported(f, m);
+    aot_error(f, m);
+}
+static void prim_error(AotFrame *f, u32 g, const char *what) { glyph_error(f, g, what, 0); }
+static void prim_unsupported(AotFrame *f, u32 g, const char *what) { glyph_error(f, g, what, 1); }
+
+static Val arith(AotFrame *f, u32 g, Val w, Val x) {
+    if (!is_num(x) || (w && !is_num(w))) prim_unsupported(f, g, "only numbers are supported natively");
+    Arr *xa = val_as_arr(x), *wa = w ? val_as_arr(w) : NULL;
+    Arr *s = wa && wa->rank ? wa : xa;  // shape of the result
+    if (wa && wa->rank && xa->rank && !same_shape(wa, xa)) prim_error(f, g, "Argument shapes don't match");
+    Arr *r = arr_new(el_f64, s->rank, s->sh);
+    f64 *rd = r->data;
+    for (ux i=0; i<r->ia; i++) {
+        f64 xv = num_at(xa, xa->rank ? i : 0);
+        rd[i] = wa ? arith2(g, num_at(wa, wa->rank ? i : 0), xv) : arith1(g, xv);
+    }
+    val_dec(w); val_dec(x);
+    return val_arr(r);
+}
+
+// a kernel result, flattened if it's a view; NULL raises err
+static Val kernel(AotFrame *f, u32 g, Arr *r, const char *err) {
+    if (!r) prim_error(f, g, err);
+    Arr *a = arr_flat(r);
+    ptr_dec(r);
+    return val_arr(a);
+}
+
+static f64 atom_num(AotFrame *f, u32 g, Val v) {
+    if (!is_num(v) || val_as_arr(v)->rank) prim_unsupported(f, g, "only a number is supported natively here");
+    return num_at(val_as_arr(v), 0);
+}
+
+static const char *rep_message(void) {
+    switch (replicate_error()) {
+        case rep_length: return "Lengths of components of 𝕨 must match 𝕩";
+        case rep_rank:   return "Argument must have rank 1 or more";
+        case rep_range:  return "Counts must be natural numbers";
+        default:         return "Counts must be numbers";
+    }
+}
+
+// x and w as arrays for a kernel, or an unsupported error for functions
+static Arr *arg(AotFrame *f, u32 g, Val v) {
+    if (!val_is_arr(v)) prim_unsupported(f, g, "only arrays are supported natively");
+    return val_as_arr(v);
+}
+
+// structural and searching primitives through the engine's kernels
+static Val prim_kernel(AotFrame *f, u32 g, Val w, Val x) {
+    Arr *xa = arg(f, g, x), *wa = w ? arg(f, g, w) : NULL, *r = NULL;
+    const char *err = "Argument shapes don't match";
+    Arr *cells = !w ? (has(U"⍋⍒∧∨⊐∊⍷⌽/", g) ? xa : NULL)
+               : has(U"⊐⊒", g) ? wa : has(U"∊/↑↓", g) ? xa : NULL;
+    if (cells && !cells->rank) prim_unsupported(f, g, "rank 0 arguments aren't supported natively");
+    if (!w) switch (g) {
+        case U'⍋': r = grade_up(xa); break;
+        case U'⍒': r = grade_down(xa); break;
+        case U'∧': r = sort_up(xa); break;
+        case U'∨': r = sort_down(xa); break;
+        case U'⊐': r = classify(xa); break;
+        case U'∊': r = mark_firsts(xa); break;
+        case U'⍷': r = deduplicate(xa); break;
+        case U'/': r = indices(xa); err = rep_message(); break;
+        case U'⌽': r = view_reverse(xa); break;
+        case U'⍉': r = view_transpose(xa); break;
+        case U'↕': {
+            f64 n = atom_num(f, g, x);
+            if (n != floor(n) || n < 0 || n >= 2147483648.0) prim_error(f, g, "Argument must be a natural number");
+            r = arr_vec(el_i32, n);
+            for (ux i=0; i<r->ia; i++) ((i32*)r->data)[i] = i;
+            break;
+        }
+        case U'≢': {
+            r = arr_vec(el_f64, xa->rank);
+            for (ux i=0; i<xa->rank; i++) ((f64*)r->data)[i] = xa->sh[i];
+            break;
+        }
+        case U'⥊': r = view_reshape(xa, 1, &xa->ia); break;
+        default: return 0;
+    } else switch (g) {
+        case U'⊐': r = index_of(wa, xa); break;
+        case U'∊': r = member_of(wa, xa); break;
+        case U'⊒': r = progressive_index_of(wa, xa); break;
+        case U'/': r = replicate(wa, xa); err = rep_message(); break;
+        case U'↑': r = view_take(xa, atom_num(f, g, w)); break;
+        case U'↓': r = view_drop(xa, atom_num(f, g, w)); break;
+        default: return 0;
+    }
+    Val v = kernel(f, g, r, err);
+    val_dec(w); val_dec(x);
+    return v;
+}
+
+static Val prim(AotFrame *f, u32 g, Val w, Val x) {
+    if (g == U'⊢') { val_dec(w); return x; }
+    if (g == U'⊣') { if (!w) return x; val_dec(x); return w; }
+    if (g == U'≠' && !w) {
+        if (!val_is_arr(x)) prim_unsupported(f, g, "only arrays are supported natively");
+        Arr *a = val_as_arr(x);
+        Val r = aot_num(a->rank ? a->sh[0] : 1);
+        val_dec(x);
+        return r;
+    }
+    if (has(w ? dyadic_arith : monadic_arith, g)) return arith(f, g, w, x);
+    Val r = prim_kernel(f, g, w, x);
+    if (!r) prim_unsupported(f, g, "primitive isn't supported natively");
+    return r;
+}
+
+/*
+ * Blocks and calls
+ * w is 0 for a monadic call.
+ */
+static Val call(AotFrame *f, Val F, Val w, Val x);
+static Val call_derived(AotFrame *f, Obj *d, Val w, Val x);
+
+// try each body for the valence with a new environment whose first slots
+// are the na values of a, which are consumed
+static Val run_bodies(AotFrame *f, const AotBlock *b, Obj *parent, int dyad, Val *a, u32 na) {
+    const AotProgram *p = f->p;
+    u32 n = dyad ? b->dyad : b->monad;
+    const u32 *bs = p->block_bodies + b->bodies + (dyad ? b->monad : 0);
+    if (!n) aot_error(f, dyad ? "Left argument not allowed" : "Left argument required");
+    for (u32 k=0; k<n; k++) {
+        const AotBody *bd = &p->bodies[bs[k]];
+        Obj *env = obj_new(obj_env, parent, 0, bd->vars);
+        for (u32 i=0; i<na && i<bd->vars; i++) { val_inc(a[i]); env->slot[i] = a[i]; }
+        AotFrame fr = { p, env, 0 };
+        Val r = bd->run(&fr);
+        obj_dec(env);
+        if (r != AOT_SKIP) {
+            for (u32 i=0; i<na; i++) val_dec(a[i]);
+            gc_poll();
+            return r;
+        }
+    }
+    aot_error(f, "No matching case");
+    return 0;
+}
+
+Val aot_block(AotFrame *f, u32 i) {
+    const AotBlock *b = &f->p->blocks[i];
+    if (!b->type && b->imm) return run_bodies(f, b, f->env, 0, NULL, 0);
+    return val_obj(obj_new(obj_closure, f->env, i, 0));
+}
+
+static Val call(AotFrame *f, Val F, Val w, Val x) {
+    if (F == AOT_NOTHING) aot_error(f, "Can't call Nothing (·)");
+    if (val_is_arr(F)) { val_dec(w); val_dec(x); return F; }
+    Obj *o = val_as_obj(F);
+    switch (o->kind) {
+        case obj_prim: {
+            u32 g = o->block;
+            obj_dec(o);
+            return prim(f, g, w, x);
+        }
+        case obj_train: {
+            Val l = 0;
+            if (o->slot[0]) {
+                val_inc(o->slot[0]); val_inc(w); val_inc(x);
+                l = call(f, o->slot[0], w, x);
+            }
+            val_inc(o->slot[2]);
+            Val r = call(f, o->slot[2], w, x);
+            val_inc(o->slot[1]);
+            Val res = call(f, o->slot[1], l, r);
+            obj_dec(o);
+            return res;
+        }
+        case obj_closure: {
+            const AotBlock *b = &f->p->blocks[o->block];
+            if (b->type) aot_error(f, "Can't call a modifier");
+            Val a[] = { F, x, w ? w : AOT_NOTHING };
+            return run_bodies(f, b, o->parent, w != 0, a, 3);
+        }
+        case obj_derived:
+            return call_derived(f, o, w, x);
+    }
+    aot_error(f, "Can't call this value natively");
+    return 0;
+}
+
+Val aot_call1(AotFrame *f, Val F, Val x) { return call(f, F, 0, x); }
+Val aot_call2(AotFrame *f, Val w, Val F, Val x) { return call(f, F, w, x); }
+
+Val aot_call1n(AotFrame *f, Val F, Val x) {
+    if (x == AOT_NOTHING) { val_dec(F); return x; }
+    return call(f, F, 0, x);
+}
+
+Val aot_call2n(AotFrame *f, Val w, Val F, Val x) {
+    if (x == AOT_NOTHING) { val_dec(F); val_dec(w); return x; }
+    return call(f, F, w == AOT_NOTHING ? 0 : w, x);
+}
+
+static Val train(Val F, Val g, Val h) {
+    Obj *t = obj_new(obj_train, NULL, 0, 3);
+    t->slot[0] = F; t->slot[1] = g; t->slot[2] = h;
+    return val_obj(t);
+}
+
+Val aot_train2(AotFrame *f, Val g, Val h) { (void)f; return train(0, g, h); }
+Val aot_train3(AotFrame *f, Val F, Val g, Val h) { (void)f; return train(F == AOT_NOTHING ? 0 : F, g, h); }
+
+void aot_need_w(AotFrame *f, Val w) {
+    if (w == AOT_NOTHING) aot_error(f, "Left argument required");
+}
+
+/*
+ * Modifiers
+ * A derived function holds its operands and the modifier in slots f m g,
+ * g being 0 for a 1-modifier. Block modifiers run with 𝕣 𝕗 𝕘 after the
+ * function slots 𝕤 𝕩 𝕨, or alone if immediate. ¨ ⌜ ´ ˝ go through the
+ * engine's apply.c, and arithmetic ´ and ` through arith.c.
+ */
+static Val modifier(AotFrame *f, Val F, Val M, Val G, u8 type) {
+    Obj *m = val_is_arr(M) ? NULL : val_as_obj(M);
+    int block = m && m->kind == obj_closure;
+    if (!m || (block ? f->p->blocks[m->block].type : has(U"˜¨⌜´˝`", m->block) ? 1 : 2) != type)
+        aot_error(f, type == 1 ? "Can't apply a value that isn't a 1-modifier" : "Can't apply a value that isn't a 2-modifier");
+    if (block && f->p->blocks[m->block].imm) {
+        Val a[] = { M, F, G };
+        return run_bodies(f, &f->p->blocks[m->block], m->parent, 0, a, type+1);
+    }
+    Obj *d = obj_new(obj_derived, NULL, 0, 3);
+    d->slot[0] = F; d->slot[1] = M; d->slot[2] = G;
+    return val_obj(d);
+}
+
+Val aot_mod1(AotFrame *f, Val F, Val M) { return modifier(f, F, M, 0, 1); }
+Val aot_mod2(AotFrame *f, Val F, Val M, Val G) { return modifier(f, F, M, G, 2); }
+
+typedef struct { AotFrame *f; Val F; } AotFn;
+
+// calls back from apply.c, which may pass views; a function result can't
+// go in an array here
+static Arr *fn_call(Fn *fn, Arr *w, Arr *x) {
+    AotFn *c = fn->ctx;
+    val_inc(c->F);
+    Val r = call(c->f, c->F, w ? val_arr(arr_flat(w)) : 0, val_arr(arr_flat(x)));
+    if (!val_is_arr(r) || r == AOT_NOTHING) unsupported(c->f, "Arrays of functions aren't supported natively");
+    return val_as_arr(r);
+}
+
+// element i of x as a value
+static Val elem(Arr *x, ux i) {
+    if (x->type == el_arr) return val_arr(ptr_inc(((Arr**)x->data)[i]));
+    return x->type >= el_c8 ? aot_chr(num_at(x, i)) : aot_num(num_at(x, i));
+}
+
+// a nested result of atoms as a flat array, as aot_list makes them
+static Arr *unnest(Arr *r) {
+    int num = 1, chr = 1;
+    for (ux i=0; i<r->ia; i++) {
+        Val v = val_arr(((Arr**)r->data)[i]);
+        int atom = val_as_arr(v)->rank == 0;
+        num &= atom && is_num(v);
+        chr &= atom && is_chr(v);
+    }
+    if (!r->ia || !(num || chr)) return r;
+    Arr *a = arr_new(num ? el_f64 : el_c32, r->rank, r->sh);
+    for (ux i=0; i<r->ia; i++) {
+        f64 x = num_at(((Arr**)r->data)[i], 0);
+        if (num) ((f64*)a->data)[i] = x; else ((u32*)a->data)[i] = x;
+    }
+    ptr_dec(r);
+    return a;
+}
+
+static int arith_op(Val F) {
+    if (val_is_arr(F) || val_as_obj(F)->kind != obj_prim) return -1;
+    switch (val_as_obj(F)->block) {
+        case U'+': return op_add;
+        case U'⌈': return op_max;
+        case U'⌊': return op_min;
+        case U'∧': return op_and;
+        case U'∨': return op_or;
+        default:   return -1;
+    }
+}
+
+// ¨ ⌜ ´ ˝ `, on arrays only; these borrow w and x
+static Arr *apply_mod(AotFrame *f, u32 m, Val F, Arr *w, Arr *x) {
+    AotFn c = { f, F };
+    Fn fn = { fn_call, 0, 0, &c };  // not pure: a call may raise an error at any point
+    int op = arith_op(F);
+    Arr *r = NULL;
+    switch (m) {
+        case U'¨': case U'⌜':
+            if (!x->rank && (!w || !w->rank)) break;  // an enclosed result
+            if (w && (m == U'⌜' || !w->rank || !x->rank)) return unnest(table(&fn, w, x));
+            if (w && w->rank != x->rank) break;
+            if (!(r = each(&fn, w, x))) prim_error(f, m, "Expected equal shape prefix");
+            return unnest(r);
+        case U'´':
+            if (w || x->rank != 1) break;
+            if (op >= 0 && (r = reduce_arith(op, x))) return r;
+            return fold(&fn, x);  // NULL if empty: the identity is left to the interpreter
+        case U'˝':
+            if (w || !x->rank) break;
+            return insert(&fn, x);
+        case U'`':
+            if (w || x->rank != 1) break;
+            if (op >= 0 && (r = scan_arith(op, x))) return r;
+            r = arr_vec(el_arr, x->ia);
+            for (ux i=0; i<x->ia; i++) {
+                Val v = elem(x, i);
+                if (i) { val_inc(F); v = call(f, F, val_arr(ptr_inc(((Arr**)r->data)[i-1])), v); }
+                if (!val_is_arr(v)) unsupported(f, "Arrays of functions aren't supported natively");
+                ((Arr**)r->data)[i] = val_as_arr(v);
+            }
+            return unnest(r);
+    }
+    return NULL;
+}
+
+static Val call_derived(AotFrame *f, Obj *d, Val w, Val x) {
+    Val F = d->slot[0], M = d->slot[1], G = d->slot[2], r;
+    val_inc(F); val_inc(M); val_inc(G);
+    Obj *m = val_as_obj(M);
+    if (m->kind == obj_closure) {
+        Val a[] = { val_obj(d), x, w ? w : AOT_NOTHING, M, F, G };
+        return run_bodies(f, &f->p->blocks[m->block], m->parent, w != 0, a, G ? 6 : 5);
+    }
+    u32 g = m->block;
+    obj_dec(m); obj_dec(d);
+    switch (g) {
+        case U'˜': if (!w) { val_inc(x); w = x; } r = call(f, F, x, w); break;
+        case U'∘': r = call(f, F, 0, call(f, G, w, x)); break;
+        case U'○': {
+            Val l = 0;
+            if (w) { val_inc(G); l = call(f, G, 0, w); }
+            r = call(f, F, l, call(f, G, 0, x));
+            break;
+        }
+        case U'⊸': if (!w) { val_inc(x); w = x; } r = call(f, G, call(f, F, 0, w), x); break;
+        case U'⟜': if (!w) { val_inc(x); w = x; } r = call(f, F, w, call(f, G, 0, x)); break;
+        case U'⊘': if (w) { val_dec(F); r = call(f, G, w, x); } else { val_dec(G); r = call(f, F, 0, x); } break;
+        case U'⍟': {
+            if (!val_is_arr(G)) { val_inc(w); val_inc(x); G = call(f, G, w, x); }
+            f64 n = atom_num(f, g, G);
+            val_dec(G);
+            if (n != floor(n) || n < 0) prim_unsupported(f, g, "only a natural number of repetitions is supported natively");
+            for (; n > 0; n--) { val_inc(F); val_inc(w); x = call(f, F, w, x); }
+            val_dec(F); val_dec(w);
+            r = x;
+            break;
+        }
+        default: {
+            Arr *wa = w ? arg(f, g, w) : NULL, *xa = arg(f, g, x);
+            Arr *a = apply_mod(f, g, F, wa, xa);
+            if (!a) prim_unsupported(f, g, "case isn't supported natively");
+            val_dec(F); val_dec(w); val_dec(x);
+            r = val_arr(a);
+        }
+    }
+    return r;
+}
+
+/*
+ * Variables
+ * An unset slot holds 0.
+ */
+static Obj *frame_env(AotFrame *f, u32 d) {
+    Obj *e = f->env;
+    while (d--) e = e->parent;
+    return e;
+}
+
+Val aot_var(AotFrame *f, u32 d, u32 s) {
+    Val v = frame_env(f, d)->slot[s];
+    if (!v) aot_error(f, "Variable referenced before definition");
+    val_inc(v);
+    return v;
+}
+
+Val aot_define(AotFrame *f, u32 d, u32 s, Val v) {
+    val_inc(v);
+    obj_set(frame_env(f, d), s, v);
+    return v;
+}
+
+Val aot_change(AotFrame *f, u32 d, u32 s, Val v) {
+    if (!frame_env(f, d)->slot[s]) aot_error(f, "↩: Variable modified before definition");
+    return aot_define(f, d, s, v);
+}
+
+Val aot_modify1(AotFrame *f, u32 d, u32 s, Val F) {
+    return aot_change(f, d, s, call(f, F, 0, aot_var(f, d, s)));
+}
+
+Val aot_modify2(AotFrame *f, u32 d, u32 s, Val F, Val x) {
+    return aot_change(f, d, s, call(f, F, aot_var(f, d, s), x));
+}
+
+/*
+ * Headers
+ */
+int aot_pred(AotFrame *f, Val x) {
+    f64 v = -1;
+    if (is_num(x) && val_as_arr(x)->rank == 0) v = num_at(val_as_arr(x), 0);
+    val_dec(x);
+    if (v != 0 && v != 1) aot_error(f, "Predicate value must be 0 or 1");
+    return v == 1;
+}
+
+int aot_match(AotFrame *f, Val c, Val x) {
+    (void)f;
+    int m = c == x;
+    if (!m && val_is_arr(c) && val_is_arr(x)) {
+        Arr *a = val_as_arr(c), *b = val_as_arr(x);
+        m = a->type != el_arr && b->type != el_arr && is_chr(c) == is_chr(x) && same_shape(a, b);
+        for (ux i=0; m && i<a->ia; i++) m = num_at(a, i) == num_at(b, i);
+    }
+    val_dec(c); val_dec(x);
+    return m;
+}
+
+/*
+ * Entry points
+ */
+i32 aot_run(const AotProgram *p) {
+    jmp_buf jb;
+    on_error = &jb;
+    val_dec(result); result = 0;
+    err_start = err_end = -1; err_msg[0] = 0; err_unsupported = 0;
+    Val *c = calloc(p->nconsts, sizeof(Val));
+    i32 status = 0;
+    if (!setjmp(jb)) {
+        p->consts(c);
+        consts = c;
+        AotFrame top = { p, NULL, 0 };
+        result = aot_block(&top, 0);
+    } else {
+        status = -1;  // what the failed bodies held is leaked
+    }
+    for (u32 i=0; i<p->nconsts; i++) val_dec(c[i]);
+    free(c);
+    consts = NULL;
+    gc_collect();
+    return status;
+}
+
+i32 aot_result_kind(void) { return is_num(result) ? 0 : is_chr(result) ? 1 : 2; }
+i64 aot_result_rank(void) { return result && val_is_arr(result) ? val_as_arr(result)->rank : -1; }
+
+i64 aot_result(f64 *r, u64 n) {
+    if (aot_result_kind() == 2) return -1;
+    Arr *a = val_as_arr(result);
+    for (u64 i=0; i<n && i<a->ia; i++) r[i] = num_at(a, i);
+    return a->ia;
+}
+
+i64 aot_error_start(void) { return err_start; }
+i64 aot_error_end(void) { return err_end; }
+i32 aot_error_unsupported(void) { return err_unsupported; }
+
+i64 aot_error_msg(u8 *r, u64 n) {
+    u64 l = strlen(err_msg);
+    memcpy(r, err_msg, l < n ? l : n);
+    return l;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "types.h"
+#include "gc.h"
+
+/*
+ * Ahead-of-time runtime
+ * Support for the C that src/aot.bqn generates from compiled bytecode.
+ * Each body becomes a straight-line function keeping the stack in locals
+ * and calling these once per instruction; AT records the bytecode
+ * position so an error reports its source range through the program's
+ * line table. Values are those of gc.h: numbers, characters and lists of
+ * them are arrays, functions are closures, trains, primitives and derived
+ * functions. Functions here consume their Val arguments and return new
+ * references.
+ *
+ * Arithmetic and comparison are native, as are the primitives and
+ * modifiers the engine has kernels for (sort.h, search.h, replicate.h,
+ * view.h, apply.h, arith.h) and the combinators. Anything else raises an
+ * error flagged as unsupported, after which the caller runs the program
+ * in the interpreter instead; native code has no side effects to repeat.
+ * Namespaces and destructuring are rejected when the C is generated.
+ */
+
+typedef struct AotProgram AotProgram;
+
+typedef struct {
+    const AotProgram *p;
+    Obj *env;
+    u32 at;    // bytecode position
+} AotFrame;
+
+typedef Val (*AotBodyFn)(AotFrame *f);
+
+typedef struct {
+    AotBodyFn run;
+    u32 vars;  // slots, special names included
+} AotBody;
+
+typedef struct {
+    u8  type, imm;     // as in the compiler's block data
+    u32 bodies;        // index in AotProgram.block_bodies
+    u32 monad, dyad;   // how many bodies are tried for each valence
+} AotBlock;
+
+struct AotProgram {
+    const AotBody *bodies;
+    const AotBlock *blocks;
+    const u32 *block_bodies;
+    u32 nconsts;
+    void (*consts)(Val *c);
+    const u32 *start, *end;  // source range by bytecode position
+};
+
+extern Arr aot_nothing_arr, aot_skip_arr;
+#define AOT_NOTHING val_arr(&aot_nothing_arr)  // ·
+#define AOT_SKIP    val_arr(&aot_skip_arr)     // a body whose header didn't match
+#define AT(i) (f->at = (i))
+
+// constants
+Val aot_num(f64 x);
+Val aot_chr(u32 c);
+Val aot_str(u64 n, const u32 *c);
+Val aot_prim(u32 glyph);
+
+// instructions
+Val aot_const(AotFrame *f, u32 i);
+Val aot_block(AotFrame *f, u32 i);
+Val aot_list(AotFrame *f, u32 n, Val *v);
+Val aot_call1(AotFrame *f, Val F, Val x);
+Val aot_call2(AotFrame *f, Val w, Val F, Val x);
+Val aot_call1n(AotFrame *f, Val F, Val x);         // either may be ·
+Val aot_call2n(AotFrame *f, Val w, Val F, Val x);
+Val aot_train2(AotFrame *f, Val g, Val h);
+Val aot_train3(AotFrame *f, Val F, Val g, Val h);  // F may be ·
+Val aot_mod1(AotFrame *f, Val F, Val m);
+Val aot_mod2(AotFrame *f, Val F, Val m, Val g);
+void aot_need_w(AotFrame *f, Val w);
+Val aot_var(AotFrame *f, u32 d, u32 s);
+Val aot_define(AotFrame *f, u32 d, u32 s, Val v);  // return v
+Val aot_change(AotFrame *f, u32 d, u32 s, Val v);
+Val aot_modify1(AotFrame *f, u32 d, u32 s, Val F);
+Val aot_modify2(AotFrame *f, u32 d, u32 s, Val F, Val x);
+int aot_pred(AotFrame *f, Val x);
+int aot_match(AotFrame *f, Val c, Val x);
+void aot_error(AotFrame *f, const char *msg);  // doesn't return
+
+/*
+ * Entry points for •FFI
+ * aot_run evaluates the program and returns 0, or -1 after an error; the
+ * result stays until the next run.
+ */
+i32 aot_run(const AotProgram *p);
+i32 aot_result_kind(void);  // 0 numbers, 1 characters, 2 other
+i64 aot_result_rank(void);
+i64 aot_result(f64 *r, u64 n);  // elements, of which the first n are copied to r
+i64 aot_error_start(void);
+i64 aot_error_end(void);
+i32 aot_error_unsupported(void);  // 1 if the error is a case the runtime lacks
+i64 aot_error_msg(u8 *r, u64 n);  // length, of which the first n bytes are copied to r
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "memory.h"
+#include "view.h"
+#include "pool.h"
+#include "apply.h"
+
+#define PAR_GRAIN  16    // fewest calls handed to a worker at once
+#define FOLD_BLOCK 4096  // folds are split at fixed multiples of this, whatever the thread count
+
+// element i of x: the element itself if nested, else a rank-0 array
+static Arr *unit(Arr *x, ux i) {
+    if (x->type==el_arr) return ptr_inc(((Arr**)x->data)[i]);
+    Arr *r = arr_new(x->type, 0, NULL);
+    if (x->type==el_bit) ((u64*)r->data)[0] = ((u64*)x->data)[i/64]>>(i%64) & 1;
+    else { ux w = el_width(x->type); memcpy(r->data, (u8*)x->data + i*w, w); }
+    return r;
+}
+
+typedef struct {
+    Fn *f;
+    Arr *w, *x;
+    Arr **r;
+    ux m;       // table: length of x
+    int err;
+} Job;
+
+static void each_body(void *ctx, ux i0, ux i1) {
+    Job *j = ctx;
+    for (ux i=i0; i<i1; i++) {
+        Arr *x = unit(j->x, i), *w = j->w ? unit(j->w, i) : NULL;
+        if (!(j->r[i] = j->f->call(j->f, w, x))) __atomic_store_n(&j->err, 1, __ATOMIC_RELAXED);
+        ptr_dec(x); if (w) ptr_dec(w);
+    }
+}
+
+static void table_body(void *ctx, ux i0, ux i1) {
+    Job *j = ctx;
+    for (ux i=i0; i<i1; i++) {
+        Arr *w = unit(j->w, i/j->m), *x = unit(j->x, i%j->m);
+        if (!(j->r[i] = j->f->call(j->f, w, x))) __atomic_store_n(&j->err, 1, __ATOMIC_RELAXED);
+        ptr_dec(x); ptr_dec(w);
+    }
+}
+
+static Arr *run(Job *j, Arr *r, void (*body)(void*, ux, ux)) {
+    j->r = r->data;
+    ux n = r->ia;
+    for (ux i=0; i<n; i++) j->r[i] = NULL;
+    if (j->f->pure) pool_for(n, PAR_GRAIN, body, j);
+    else body(j, 0, n);
+    if (!j->err) return r;
+    ptr_dec(r);
+    return NULL;
+}
+
+Arr *each(Fn *f, Arr *w, Arr *x) {
+    if (w && (w->rank!=x->rank || memcmp(w->sh, x->sh, x->rank*sizeof(ux)))) return NULL;
+    x = arr_flat(x); if (w) w = arr_flat(w);
+    Job j = { f, w, x, NULL, 0, 0 };
+    Arr *r = run(&j, arr_new(el_arr, x->rank, x->sh), each_body);
+    ptr_dec(x); if (w) ptr_dec(w);
+    return r;
+}
+
+Arr *table(Fn *f, Arr *w, Arr *x) {
+    if (w->rank + x->rank > 255) return NULL;
+    x = arr_flat(x); w = arr_flat(w);
+    ux *sh = malloc((w->rank + x->rank + 1)*sizeof(ux));
+    memcpy(sh, w->sh, w->rank*sizeof(ux));
+    memcpy(sh+w->rank, x->sh, x->rank*sizeof(ux));
+    Arr *r = arr_new(el_arr, w->rank + x->rank, sh);
+    free(sh);
+    Job j = { f, w, x, NULL, x->ia, 0 };
+    r = run(&j, r, table_body);
+    ptr_dec(x); ptr_dec(w);
+    return r;
+}
+
+/*
+ * Folds
+ * Items are elements (´) or major cells (˝). An associative function's
+ * fold is cut into blocks of FOLD_BLOCK items, each folded on some
+ * worker, and the block results are folded in order.
+ */
+typedef struct {
+    Fn *f;
+    Arr *x;
+    int cells;
+    Arr **r;    // result per block
+    int err;
+} FoldJob;
+
+static Arr *item(FoldJob *j, ux i) { return j->cells ? view_cell(j->x, i) : unit(j->x, i); }
+
+// right fold of items [i0,i1)
+static Arr *fold_range(FoldJob *j, ux i0, ux i1) {
+    Arr *r = item(j, i1-1);
+    for (ux i=i1-1; r && i-- > i0; ) {
+        Arr *w = item(j, i), *t = j->f->call(j->f, w, r);
+        ptr_dec(w); ptr_dec(r);
+        r = t;
+    }
+    return r;
+}
+
+static void fold_body(void *ctx, ux b0, ux b1) {
+    FoldJob *j = ctx;
+    ux n = j->cells ? j->x->sh[0] : j->x->ia;
+    for (ux b=b0; b<b1; b++) {
+        ux e = (b+1)*FOLD_BLOCK < n ? (b+1)*FOLD_BLOCK : n;
+        if (!(j->r[b] = fold_range(j, b*FOLD_BLOCK, e))) __atomic_store_n(&j->err, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static Arr *fold_items(Fn *f, Arr *x, int cells) {
+    ux n = cells ? x->sh[0] : x->ia;
+    if (!n) return NULL;
+    x = arr_flat(x);
+    FoldJob j = { f, x, cells, NULL, 0 };
+    if (!(f->pure && f->assoc) || n < 2*FOLD_BLOCK) { Arr *r = fold_range(&j, 0, n); ptr_dec(x); return r; }
+    ux nb = (n + FOLD_BLOCK-1) / FOLD_BLOCK;
+    j.r = calloc(nb, sizeof(Arr*));
+    pool_for(nb, 1, fold_body, &j);
+    Arr *r = NULL;
+    if (!j.err) {
+        r = ptr_inc(j.r[nb-1]);
+        for (ux b=nb-1; r && b--; ) {
+            Arr *t = f->call(f, j.r[b], r);
+            ptr_dec(r);
+            r = t;
+        }
+    }
+    for (ux b=0; b<nb; b++) if (j.r[b]) ptr_dec(j.r[b]);
+    free(j.r);
+    ptr_dec(x);
+    return r;
+}
+
+Arr *fold(Fn *f, Arr *x) { return x->rank==1 ? fold_items(f, x, 0) : NULL; }
+Arr *insert(Fn *f, Arr *x) { return x->rank ? fold_items(f, x, 1) : NULL; }
@@ -0,0 +1,23 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Function application: ¨ ⌜ ´ ˝
+ * A Fn is called on borrowed arguments, w being NULL when monadic, and
+ * returns a new array, or NULL on error. Calls to pure functions are
+ * spread across the thread pool; the results are always the same as
+ * those of a sequential run.
+ */
+
+typedef struct Fn {
+    Arr *(*call)(struct Fn *f, Arr *w, Arr *x);
+    u8 pure;   // primitives, and blocks with no assignment to outer variables and no system calls
+    u8 assoc;  // associative, so folds may be regrouped
+    void *ctx;
+} Fn;
+
+// results are nested; atoms of flat arguments are passed as rank-0 arrays
+Arr *each(Fn *f, Arr *w, Arr *x);   // w F¨ x, NULL w for F¨ x; shapes must match
+Arr *table(Fn *f, Arr *w, Arr *x);  // w F⌜ x
+Arr *fold(Fn *f, Arr *x);           // F´ x on a list, NULL if it's empty
+Arr *insert(Fn *f, Arr *x);         // F˝ x, NULL if x has no cells
@@ -0,0 +1,277 @@
+#include <stdlib.h>
+#include <math.h>
+#include "types.h"
+#include "memory.h"
+#include "view.h"
+#include "bits.h"
+#include "pool.h"
+#include "arith.h"
+
+#define BLOCK (1<<16)  // elements per block; fixed so results don't depend on the thread count
+
+static int fsum_mode = fsum_pairwise;
+void arith_fsum_mode(int mode) { fsum_mode = mode; }
+
+static int int_type(u8 t) { return t==el_i8 || t==el_i16 || t==el_i32; }
+
+static Arr *atom_i32(i32 v) { Arr *r = arr_new(el_i32, 0, NULL); *(i32*)r->data = v; return r; }
+static Arr *atom_f64(f64 v) { Arr *r = arr_new(el_f64, 0, NULL); *(f64*)r->data = v; return r; }
+static Arr *atom_i64(i64 v) { return v==(i32)v ? atom_i32(v) : atom_f64(v); }
+
+// eight independent sums so the inner loop vectorizes, then halves
+static f64 pairwise(const f64 *x, ux n) {
+    if (n > 256) { ux h = n/2; return pairwise(x, h) + pairwise(x+h, n-h); }
+    f64 s[8] = {0};
+    ux i = 0;
+    for (; i+8 <= n; i+=8) for (ux k=0; k<8; k++) s[k] += x[i+k];
+    for (ux k=0; i<n; i++, k++) s[k] += x[i];
+    return ((s[0]+s[1]) + (s[2]+s[3])) + ((s[4]+s[5]) + (s[6]+s[7]));
+}
+
+/*
+ * Block kernels
+ */
+#define RED_INT(T)                                                          \
+static i64 red_##T(int op, const T *x, ux n) {                              \
+    if (op==op_add) { i64 s = 0; for (ux i=0; i<n; i++) s += x[i]; return s; } \
+    T m = x[0];                                                             \
+    if (op==op_max) for (ux i=1; i<n; i++) m = x[i]>m ? x[i] : m;           \
+    else            for (ux i=1; i<n; i++) m = x[i]<m ? x[i] : m;           \
+    return m;                                                               \
+}
+RED_INT(i8)
+RED_INT(i16)
+RED_INT(i32)
+#undef RED_INT
+
+static f64 red_f64(int op, const f64 *x, ux n) {
+    if (op==op_add) return pairwise(x, n);
+    f64 m = x[0];
+    if (op==op_max) for (ux i=1; i<n; i++) m = x[i]>m ? x[i] : m;
+    else            for (ux i=1; i<n; i++) m = x[i]<m ? x[i] : m;
+    return m;
+}
+
+static f64 sum_left(const f64 *x, ux n) {
+    f64 s = x[0];
+    for (ux i=1; i<n; i++) s += x[i];
+    return s;
+}
+
+static i64 red_int(int op, Arr *x, ux i0, ux n) {
+    switch (x->type) {
+        case el_i8:  return red_i8 (op, (i8 *)x->data + i0, n);
+        case el_i16: return red_i16(op, (i16*)x->data + i0, n);
+        default:     return red_i32(op, (i32*)x->data + i0, n);
+    }
+}
+
+static i64 combine_int(int op, i64 a, i64 b) { return op==op_add ? a+b : op==op_max ? (a>b?a:b) : (a<b?a:b); }
+static f64 combine_f64(int op, f64 a, f64 b) { return op==op_add ? a+b : op==op_max ? (a>b?a:b) : (a<b?a:b); }
+
+typedef struct {
+    int op;
+    Arr *x;
+    ux n;
+    int left;          // f64 +: block totals summed from the left, as +` does
+    i64 *ir; f64 *fr;  // result per block
+    i64 *ia;           // sum of absolute values per block, for +` on integers
+    void *out; u8 out_type;
+} Job;
+
+static ux block_len(Job *j, ux b) { return (b+1)*BLOCK < j->n ? BLOCK : j->n - b*BLOCK; }
+
+static void reduce_body(void *ctx, ux b0, ux b1) {
+    Job *j = ctx;
+    for (ux b=b0; b<b1; b++) {
+        if (j->left) j->fr[b] = sum_left((f64*)j->x->data + b*BLOCK, block_len(j, b));
+        else if (j->fr) j->fr[b] = red_f64(j->op, (f64*)j->x->data + b*BLOCK, block_len(j, b));
+        else       j->ir[b] = red_int(j->op, j->x, b*BLOCK, block_len(j, b));
+    }
+}
+
+static Arr *reduce_bits(int op, Arr *x) {
+    u64 s = bit_sum(x);
+    switch (op) {
+        case op_add: return atom_i64(s);
+        case op_and: case op_min: return atom_i32(s==x->ia);
+        default: return atom_i32(s>0);
+    }
+}
+
+static Arr *reduce_flat(int op, Arr *x) {
+    ux n = x->ia;
+    if (!n && (op==op_max || op==op_min)) return atom_f64(op==op_max ? -INFINITY : INFINITY);  // even for booleans
+    if (x->type==el_bit) return reduce_bits(op, x);
+    if (op==op_and || op==op_or || !(int_type(x->type) || x->type==el_f64)) return NULL;
+    if (!n) return atom_i32(0);
+    if (x->type==el_f64 && op==op_add && fsum_mode==fsum_sequential) {
+        f64 *xp = x->data, s = xp[n-1];
+        for (ux i=n-1; i--; ) s = xp[i] + s;
+        return atom_f64(s);
+    }
+    ux nb = (n+BLOCK-1)/BLOCK;
+    Job j = { .op = op, .x = x, .n = n };
+    if (x->type==el_f64) j.fr = malloc(nb*sizeof(f64)); else j.ir = malloc(nb*sizeof(i64));
+    pool_for(nb, 1, reduce_body, &j);
+    Arr *r;
+    if (j.fr) {
+        r = atom_f64(op==op_add ? pairwise(j.fr, nb) : red_f64(op, j.fr, nb));
+        free(j.fr);
+    } else {
+        i64 v = j.ir[0];
+        for (ux b=1; b<nb; b++) v = combine_int(op, v, j.ir[b]);
+        r = atom_i64(v);
+        free(j.ir);
+    }
+    return r;
+}
+
+/*
+ * Scans: block totals in parallel, carries in order, then each block
+ * scanned from its carry in parallel
+ * Integer blocks have a loop for each pair of argument and result types.
+ * f64 + scans each block from its first element and adds the carry to
+ * every partial sum, so a block ends exactly on the carry into the next;
+ * that's the block totals added in order, which can differ from +´ in
+ * the last bits as that sums pairwise (or from the right).
+ */
+#define SCAN_INT(T, U)                                                      \
+static void scan_##T##_##U(int op, const T *x, U *o, ux n, i64 c, int first) { \
+    ux i = 0;                                                               \
+    if (first) { o[0] = c = x[0]; i = 1; }                                  \
+    if (op==op_add)      for (; i<n; i++) o[i] = c += x[i];                 \
+    else if (op==op_max) for (; i<n; i++) o[i] = c = x[i]>c ? x[i] : c;     \
+    else                 for (; i<n; i++) o[i] = c = x[i]<c ? x[i] : c;     \
+}
+#define SCAN_INTS(T)                                                        \
+SCAN_INT(T, i8) SCAN_INT(T, i16) SCAN_INT(T, i32) SCAN_INT(T, f64)          \
+static void scan_##T(int op, const T *x, void *o, u8 out_type, ux n, i64 c, int first) { \
+    switch (out_type) {                                                     \
+        case el_i8:  scan_##T##_i8 (op, x, (i8 *)o, n, c, first); break;    \
+        case el_i16: scan_##T##_i16(op, x, (i16*)o, n, c, first); break;    \
+        case el_i32: scan_##T##_i32(op, x, (i32*)o, n, c, first); break;    \
+        default:     scan_##T##_f64(op, x, (f64*)o, n, c, first); break;    \
+    }                                                                       \
+}                                                                           \
+static i64 abs_##T(const T *x, ux n) {                                      \
+    i64 s = 0;                                                              \
+    for (ux i=0; i<n; i++) s += x[i]<0 ? -(i64)x[i] : x[i];                 \
+    return s;                                                               \
+}
+SCAN_INTS(i8)
+SCAN_INTS(i16)
+SCAN_INTS(i32)
+#undef SCAN_INTS
+#undef SCAN_INT
+
+static void abs_body(void *ctx, ux b0, ux b1) {
+    Job *j = ctx;
+    for (ux b=b0; b<b1; b++) {
+        ux i0 = b*BLOCK, n = block_len(j, b);
+        switch (j->x->type) {
+            case el_i8:  j->ia[b] = abs_i8 ((i8 *)j->x->data + i0, n); break;
+            case el_i16: j->ia[b] = abs_i16((i16*)j->x->data + i0, n); break;
+            default:     j->ia[b] = abs_i32((i32*)j->x->data + i0, n); break;
+        }
+    }
+}
+
+static void scan_body(void *ctx, ux b0, ux b1) {
+    Job *j = ctx;
+    for (ux b=b0; b<b1; b++) {
+        ux i0 = b*BLOCK, n = block_len(j, b);
+        int op = j->op;
+        if (j->x->type==el_f64) {
+            const f64 *xp = (f64*)j->x->data + i0;
+            f64 *o = (f64*)j->out + i0;
+            if (op==op_add) {
+                f64 s = xp[0];
+                if (!b) { o[0] = s; for (ux i=1; i<n; i++) o[i] = s += xp[i]; }
+                else { f64 c = j->fr[b-1]; o[0] = c + s; for (ux i=1; i<n; i++) o[i] = c + (s += xp[i]); }
+                continue;
+            }
+            f64 c = b ? j->fr[b-1] : xp[0];
+            ux i = b ? 0 : 1;
+            if (!b) o[0] = c;
+            if (op==op_max) for (; i<n; i++) o[i] = c = xp[i]>c ? xp[i] : c;
+            else            for (; i<n; i++) o[i] = c = xp[i]<c ? xp[i] : c;
+        } else {
+            i64 c = b ? j->ir[b-1] : 0;
+            void *o = (u8*)j->out + i0*el_width(j->out_type);
+            switch (j->x->type) {
+                case el_i8:  scan_i8 (op, (i8 *)j->x->data + i0, o, j->out_type, n, c, !b); break;
+                case el_i16: scan_i16(op, (i16*)j->x->data + i0, o, j->out_type, n, c, !b); break;
+                default:     scan_i32(op, (i32*)j->x->data + i0, o, j->out_type, n, c, !b); break;
+            }
+        }
+    }
+}
+
+static Arr *scan_bits(int op, Arr *x) {
+    switch (op) {
+        case op_and: case op_min: return bit_scan_and(x);
+        case op_or:  case op_max: return bit_scan_or(x);
+    }
+    Arr *r = arr_vec(el_i32, x->ia);
+    u64 *xp = x->data; i32 *rp = r->data;
+    i32 c = 0;
+    for (ux i=0; i<x->ia; i++) rp[i] = c += xp[i/64]>>(i%64) & 1;
+    return r;
+}
+
+static Arr *scan_flat(int op, Arr *x) {
+    if (x->type==el_bit) return scan_bits(op, x);
+    if (op==op_and || op==op_or || !(int_type(x->type) || x->type==el_f64)) return NULL;
+    ux n = x->ia, nb = (n+BLOCK-1)/BLOCK;
+    Job j = { .op = op, .x = x, .n = n };
+    int f = x->type==el_f64;
+    if (f) j.fr = malloc(nb*sizeof(f64)+1); else j.ir = malloc(nb*sizeof(i64)+1);
+    Arr *r;
+    if (f && op==op_add && fsum_mode==fsum_sequential) {
+        r = arr_vec(el_f64, n);
+        f64 *xp = x->data, *rp = r->data, c = n ? xp[0] : 0;
+        if (n) rp[0] = c;
+        for (ux i=1; i<n; i++) rp[i] = c += xp[i];
+        free(j.fr);
+        return r;
+    }
+    j.left = f && op==op_add;
+    pool_for(nb, 1, reduce_body, &j);
+    j.out_type = f ? el_f64 : x->type;  // ⌈` and ⌊` keep the element type
+    if (!f && op==op_add) {
+        // i32 holds every partial sum if the absolute values add up to at most INT32_MAX
+        j.ia = malloc(nb*sizeof(i64)+1);
+        pool_for(nb, 1, abs_body, &j);
+        i64 a = 0;
+        for (ux b=0; b<nb; b++) a += j.ia[b];
+        j.out_type = a > INT32_MAX ? el_f64 : el_i32;
+        free(j.ia);
+    }
+    // inclusive carries: result at the end of each block
+    for (ux b=1; b<nb; b++) {
+        if (f) j.fr[b] = combine_f64(op, j.fr[b-1], j.fr[b]);
+        else   j.ir[b] = combine_int(op, j.ir[b-1], j.ir[b]);
+    }
+    r = arr_vec(j.out_type, n);
+    j.out = r->data;
+    pool_for(nb, 1, scan_body, &j);
+    free(f ? (void*)j.fr : (void*)j.ir);
+    return r;
+}
+
+Arr *reduce_arith(int op, Arr *x) {
+    if (x->rank!=1) return NULL;
+    x = arr_flat(x);
+    Arr *r = reduce_flat(op, x);
+    ptr_dec(x);
+    return r;
+}
+
+Arr *scan_arith(int op, Arr *x) {
+    if (x->rank!=1) return NULL;
+    x = arr_flat(x);
+    Arr *r = scan_flat(op, x);
+    ptr_dec(x);
+    return r;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Arithmetic reductions and scans: + ⌈ ⌊ ∧ ∨ with ´ and `
+ * Lists are cut into fixed blocks that are reduced or scanned on the
+ * thread pool, then combined in order, so results don't depend on the
+ * number of threads. ∧ and ∨ are supported on booleans only.
+ * Arguments are borrowed; NULL means the case isn't handled here.
+ */
+
+enum { op_add, op_max, op_min, op_and, op_or };
+
+// f64 +: pairwise (the default) sums blocks and their results in halves;
+// sequential adds one element at a time from the right, exactly like +´,
+// and runs on one thread
+enum { fsum_pairwise, fsum_sequential };
+void arith_fsum_mode(int mode);
+
+Arr *reduce_arith(int op, Arr *x);  // op´x, as a rank-0 array
+Arr *scan_arith(int op, Arr *x);    // op`x
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "types.h"
+#include "memory.h"
+#include "sort.h"
+
+// usage: bench [max length], default 1e7; lengths go up by factors of 10 from 10
+
+static f64 now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static Arr *rand_arr(u8 type, ux n, u32 range) {
+    Arr *x = arr_vec(type, n);
+    for (ux i=0; i<n; i++) {
+        i64 v = (i64)(((u64)rand()<<16 ^ rand()) % range) - range/2;
+        switch (type) {
+            case el_i8:  ((i8 *)x->data)[i] = v; break;
+            case el_i16: ((i16*)x->data)[i] = v; break;
+            case el_i32: ((i32*)x->data)[i] = v; break;
+        }
+    }
+    return x;
+}
+
+// seconds per call, repeating short runs
+static f64 time_grade(Arr *x, int cmp) {
+    ux reps = 1 + 1000000/(x->ia+1);
+    f64 t = now();
+    for (ux i=0; i<reps; i++) ptr_dec(cmp ? grade_cmp(x, 0) : grade_up(x));
+    return (now()-t)/reps;
+}
+
+static void bench_sort(ux max) {
+    static const struct { u8 type; u32 range; const char *name; } cases[] = {
+        { el_i8,  256,        "i8"          },
+        { el_i16, 65536,      "i16"         },
+        { el_i32, 100,        "i32 small"   },
+        { el_i32, 4000000000, "i32 full"    },
+    };
+    printf("%-10s %10s %12s %12s %8s\n", "type", "length", "radix ns/el", "cmp ns/el", "speedup");
+    for (ux c=0; c<sizeof cases/sizeof *cases; c++)
+        for (ux n=10; n<=max; n*=10) {
+            Arr *x = rand_arr(cases[c].type, n, cases[c].range);
+            f64 r = time_grade(x, 0), s = time_grade(x, 1);
+            printf("%-10s %10zu %12.2f %12.2f %7.1fx\n", cases[c].name, n, 1e9*r/n, 1e9*s/n, s/r);
+            ptr_dec(x);
+        }
+}
+
+int main(int argc, char **argv) {
+    ux max = argc>1 ? (ux)atof(argv[1]) : 10000000;
+    bench_sort(max);
+    return 0;
+}
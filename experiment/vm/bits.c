@@ -0,0 +1,194 @@
+#include "types.h"
+#include "memory.h"
+#include "bits.h"
+#include "view.h"
+
+static void clear_tail(Arr *r) {
+    ux n = r->ia;
+    if (n%64) ((u64*)r->data)[n/64] &= ((u64)1<<(n%64))-1;
+}
+
+static Arr *bit_like(Arr *x) { return arr_new(el_bit, x->rank, x->sh); }
+
+Arr *bit_pack(Arr *x) {
+    x = arr_flat(x);
+    Arr *r = bit_like(x);
+    u8 *xp = x->data; u64 *rp = r->data;
+    ux n = x->ia, i = 0;
+    for (; i+64 <= n; i+=64) {
+        u64 w = 0;
+        for (ux j=0; j<64; j++) w |= (u64)(xp[i+j]&1) << j;
+        rp[i/64] = w;
+    }
+    if (i<n) {
+        u64 w = 0;
+        for (ux j=0; i+j<n; j++) w |= (u64)(xp[i+j]&1) << j;
+        rp[i/64] = w;
+    }
+    ptr_dec(x);
+    return r;
+}
+
+Arr *bit_unpack(Arr *x) {
+    x = arr_flat(x);
+    Arr *r = arr_new(el_i8, x->rank, x->sh);
+    u64 *xp = x->data; i8 *rp = r->data;
+    for (ux i=0; i<x->ia; i++) rp[i] = xp[i/64]>>(i%64) & 1;
+    ptr_dec(x);
+    return r;
+}
+
+#define BIT_DY(NAME, EXPR) \
+Arr *NAME(Arr *w, Arr *x) {                            \
+    w = arr_flat(w); x = arr_flat(x);                  \
+    Arr *r = bit_like(x);                              \
+    u64 *wp = w->data, *xp = x->data, *rp = r->data;   \
+    for (ux i=0, e=bit_words(x->ia); i<e; i++) {       \
+        u64 a = wp[i], b = xp[i];                      \
+        rp[i] = EXPR;                                  \
+    }                                                  \
+    ptr_dec(w); ptr_dec(x);                            \
+    return r;                                          \
+}
+BIT_DY(bit_and,    a&b)
+BIT_DY(bit_or,     a|b)
+BIT_DY(bit_xor,    a^b)
+BIT_DY(bit_andnot, a&~b)
+#undef BIT_DY
+
+Arr *bit_not(Arr *x) {
+    x = arr_flat(x);
+    Arr *r = bit_like(x);
+    u64 *xp = x->data, *rp = r->data;
+    for (ux i=0, e=bit_words(x->ia); i<e; i++) rp[i] = ~xp[i];
+    clear_tail(r);
+    ptr_dec(x);
+    return r;
+}
+
+u64 bit_sum(Arr *x) {
+    x = arr_flat(x);
+    u64 *xp = x->data, s = 0;
+    for (ux i=0, e=bit_words(x->ia); i<e; i++) s += __builtin_popcountll(xp[i]);
+    ptr_dec(x);
+    return s;
+}
+
+Arr *bit_indices(Arr *x) {
+    x = arr_flat(x);
+    u64 *xp = x->data;
+    ux n = bit_sum(x), e = bit_words(x->ia);
+    Arr *r;
+    if (x->ia <= INT32_MAX) {
+        r = arr_vec(el_i32, n);
+        i32 *rp = r->data;
+        for (ux i=0; i<e; i++)
+            for (u64 v=xp[i]; v; v&=v-1) *rp++ = i*64 + __builtin_ctzll(v);
+    } else {
+        r = arr_vec(el_f64, n);
+        f64 *rp = r->data;
+        for (ux i=0; i<e; i++)
+            for (u64 v=xp[i]; v; v&=v-1) *rp++ = i*64 + __builtin_ctzll(v);
+    }
+    ptr_dec(x);
+    return r;
+}
+
+Arr *bit_scan_or(Arr *x) {
+    x = arr_flat(x);
+    Arr *r = bit_like(x);
+    u64 *xp = x->data, *rp = r->data;
+    ux i = 0, e = bit_words(x->ia);
+    for (; i<e && !xp[i]; i++) rp[i] = 0;
+    if (i<e) { rp[i] = -(xp[i] & -xp[i]); i++; }  // ones from the lowest set bit up
+    for (; i<e; i++) rp[i] = ~(u64)0;
+    clear_tail(r);
+    ptr_dec(x);
+    return r;
+}
+
+Arr *bit_scan_and(Arr *x) {
+    x = arr_flat(x);
+    Arr *r = bit_like(x);
+    u64 *xp = x->data, *rp = r->data;
+    ux i = 0, e = bit_words(x->ia);
+    for (; i<e && !~xp[i]; i++) rp[i] = ~(u64)0;
+    if (i<e) { u64 v = ~xp[i]; rp[i] = (v & -v) - 1; i++; }  // ones below the lowest clear bit
+    for (; i<e; i++) rp[i] = 0;
+    clear_tail(r);
+    ptr_dec(x);
+    return r;
+}
+
+Arr *bit_scan_xor(Arr *x) {
+    x = arr_flat(x);
+    Arr *r = bit_like(x);
+    u64 *xp = x->data, *rp = r->data;
+    u64 c = 0;  // parity so far, all ones or all zeros
+    for (ux i=0, e=bit_words(x->ia); i<e; i++) {
+        u64 v = xp[i];
+        v ^= v<<1; v ^= v<<2; v ^= v<<4; v ^= v<<8; v ^= v<<16; v ^= v<<32;
+        v ^= c;
+        rp[i] = v;
+        c = -(v>>63);
+    }
+    clear_tail(r);
+    ptr_dec(x);
+    return r;
+}
+
+// build each result word from 64 comparisons so the inner loop has no stores
+#define CMP_LOOP(T, OP) {                                          \
+    T *wp = w->data, *xp = x->data;                                \
+    for (ux i=0; i<n; i+=64) {                                     \
+        ux m = n-i<64 ? n-i : 64;                                  \
+        u64 v = 0;                                                 \
+        for (ux j=0; j<m; j++) v |= (u64)(wp[i+j] OP xp[i+j]) << j;\
+        rp[i/64] = v;                                              \
+    }                                                              \
+} break;
+#define CMP_TYPE(T)                       \
+    switch (op) {                         \
+        case cmp_eq: CMP_LOOP(T, ==)      \
+        case cmp_ne: CMP_LOOP(T, !=)      \
+        case cmp_lt: CMP_LOOP(T, <)       \
+        case cmp_le: CMP_LOOP(T, <=)      \
+        case cmp_gt: CMP_LOOP(T, >)       \
+        case cmp_ge: CMP_LOOP(T, >=)      \
+    } break;
+
+static Arr *bit_cmp_bit(int op, Arr *w, Arr *x) {
+    Arr *t, *r;
+    switch (op) {
+        case cmp_ne: return bit_xor(w, x);
+        case cmp_lt: return bit_andnot(x, w);
+        case cmp_gt: return bit_andnot(w, x);
+        case cmp_eq: t = bit_xor(w, x);    break;
+        case cmp_le: t = bit_andnot(w, x); break;
+        default:     t = bit_andnot(x, w); break;
+    }
+    r = bit_not(t);
+    ptr_dec(t);
+    return r;
+}
+
+Arr *bit_cmp(int op, Arr *w, Arr *x) {
+    if (x->type==el_bit) return bit_cmp_bit(op, w, x);
+    w = arr_flat(w); x = arr_flat(x);
+    Arr *r = bit_like(x);
+    u64 *rp = r->data;
+    ux n = x->ia;
+    switch (x->type) {
+        case el_i8:  CMP_TYPE(i8)
+        case el_i16: CMP_TYPE(i16)
+        case el_i32: CMP_TYPE(i32)
+        case el_f64: CMP_TYPE(f64)
+        case el_c8:  CMP_TYPE(u8)
+        case el_c16: CMP_TYPE(u16)
+        case el_c32: CMP_TYPE(u32)
+    }
+    ptr_dec(w); ptr_dec(x);
+    return r;
+}
+#undef CMP_TYPE
+#undef CMP_LOOP
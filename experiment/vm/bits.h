@@ -0,0 +1,32 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Packed boolean kernels
+ * Arguments are borrowed, results are new arrays with refcount 1.
+ * Dyadic functions require arguments of equal length.
+ */
+
+// pack 0/1 i8 data into el_bit, and the reverse
+Arr *bit_pack(Arr *x);
+Arr *bit_unpack(Arr *x);
+
+// w∧x w∨x w≠x w>x and ¬x
+Arr *bit_and(Arr *w, Arr *x);
+Arr *bit_or(Arr *w, Arr *x);
+Arr *bit_xor(Arr *w, Arr *x);
+Arr *bit_andnot(Arr *w, Arr *x);
+Arr *bit_not(Arr *x);
+
+// +´x
+u64 bit_sum(Arr *x);
+// /x, as i32 when it fits and f64 otherwise
+Arr *bit_indices(Arr *x);
+// ∨`x ∧`x ≠`x
+Arr *bit_scan_or(Arr *x);
+Arr *bit_scan_and(Arr *x);
+Arr *bit_scan_xor(Arr *x);
+
+// w=x w≠x w<x w≤x w>x w≥x on equal numeric types, giving el_bit
+enum { cmp_eq, cmp_ne, cmp_lt, cmp_le, cmp_gt, cmp_ge };
+Arr *bit_cmp(int op, Arr *w, Arr *x);
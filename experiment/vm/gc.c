@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "types.h"
+#include "memory.h"
+#include "gc.h"
+
+#define GC_ROOTS (4*GC_SLICE)  // buffered roots that raise a request
+#define GC_BYTES (1<<20)       // allocated bytes that raise one
+
+enum { black, gray, white, purple };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static Obj **roots; static ux nroots, roots_cap;
+static u64 since_bytes;
+static int requested;
+static GcStats stats;
+
+static void obj_free(Obj *o) {
+    for (u32 i=0; i<o->n; i++) if (val_is_arr(o->slot[i])) ptr_dec(val_as_arr(o->slot[i]));
+    mem_free(o, o->mem);
+}
+
+Obj *obj_new(u8 kind, Obj *parent, u32 block, u32 n) {
+    ux size = sizeof(Obj) + n*sizeof(Val);
+    u8 cls = mem_class(size);
+    Obj *o = mem_alloc(cls, size);
+    if (!o) return NULL;
+    o->refc = 1; o->kind = kind; o->mem = cls; o->color = black; o->root = 0;
+    o->block = block; o->n = n;
+    if (parent) obj_inc(parent);
+    o->parent = parent;
+    for (u32 i=0; i<n; i++) o->slot[i] = 0;
+    if (__atomic_add_fetch(&since_bytes, size, __ATOMIC_RELAXED) >= GC_BYTES) requested = 1;
+    return o;
+}
+
+void obj_set(Obj *o, u32 i, Val v) {
+    Val old = o->slot[i];
+    o->slot[i] = v;
+    val_dec(old);
+}
+
+void obj_inc(Obj *o) {
+    __atomic_fetch_add(&o->refc, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&o->color, black, __ATOMIC_RELAXED);
+}
+
+static void possible_root(Obj *o) {
+    pthread_mutex_lock(&lock);
+    if (o->color != purple) {
+        o->color = purple;
+        if (!o->root) {
+            if (nroots == roots_cap) {
+                roots_cap = roots_cap ? 2*roots_cap : 64;
+                roots = realloc(roots, roots_cap*sizeof(Obj*));
+            }
+            roots[nroots++] = o;
+            o->root = nroots;
+            stats.roots++;
+            if (nroots >= GC_ROOTS) requested = 1;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void obj_dec(Obj *o) {
+    if (__atomic_sub_fetch(&o->refc, 1, __ATOMIC_ACQ_REL)) { possible_root(o); return; }
+    if (o->parent) obj_dec(o->parent);
+    for (u32 i=0; i<o->n; i++) if (o->slot[i] && !val_is_arr(o->slot[i])) obj_dec(val_as_obj(o->slot[i]));
+    pthread_mutex_lock(&lock);
+    o->color = black;
+    int buffered = o->root;  // the collector frees it when reached
+    pthread_mutex_unlock(&lock);
+    if (!buffered) obj_free(o);
+}
+
+void val_inc(Val v) {
+    if (!v) return;
+    if (val_is_arr(v)) ptr_inc(val_as_arr(v)); else obj_inc(val_as_obj(v));
+}
+
+void val_dec(Val v) {
+    if (!v) return;
+    if (val_is_arr(v)) ptr_dec(val_as_arr(v)); else obj_dec(val_as_obj(v));
+}
+
+/*
+ * Collection
+ * The graph walks use an explicit stack, as environment chains can be long.
+ */
+static Obj **stack; static ux sp, stack_cap;
+
+static void push(Obj *o) {
+    if (sp == stack_cap) {
+        stack_cap = stack_cap ? 2*stack_cap : 256;
+        stack = realloc(stack, stack_cap*sizeof(Obj*));
+    }
+    stack[sp++] = o;
+}
+
+// push each child, applying d to its count
+static void push_children(Obj *o, int d) {
+    if (o->parent) { o->parent->refc += d; push(o->parent); }
+    for (u32 i=0; i<o->n; i++) {
+        Val v = o->slot[i];
+        if (v && !val_is_arr(v)) { val_as_obj(v)->refc += d; push(val_as_obj(v)); }
+    }
+}
+
+// subtract internal references
+static void mark_gray(Obj *s) {
+    ux base = sp;
+    push(s);
+    while (sp > base) {
+        Obj *o = stack[--sp];
+        if (o->color == gray) continue;
+        o->color = gray;
+        push_children(o, -1);
+    }
+}
+
+// restore the counts of everything reachable from an externally held object
+static void scan_black(Obj *s) {
+    ux base = sp;
+    push(s);
+    while (sp > base) {
+        Obj *o = stack[--sp];
+        if (o->color == black) continue;
+        o->color = black;
+        push_children(o, +1);
+    }
+}
+
+static void scan(Obj *s) {
+    ux base = sp;
+    push(s);
+    while (sp > base) {
+        Obj *o = stack[--sp];
+        if (o->color != gray) continue;
+        if (o->refc > 0) {
+            scan_black(o);  // on the stack above what is pending
+        } else {
+            o->color = white;
+            push_children(o, 0);
+        }
+    }
+}
+
+// free white objects, taking any still buffered out of the buffer
+static void collect_white(Obj *s) {
+    Obj *dead = NULL;
+    ux base = sp;
+    push(s);
+    while (sp > base) {
+        Obj *o = stack[--sp];
+        if (o->color != white) continue;
+        o->color = black;
+        if (o->root) { roots[o->root-1] = NULL; o->root = 0; }
+        push_children(o, 0);
+        o->parent = dead; dead = o;  // children are read above, so parent can link the list
+    }
+    while (dead) {
+        Obj *n = dead->parent;
+        obj_free(dead);
+        stats.freed++;
+        dead = n;
+    }
+}
+
+static void slice(ux count) {
+    if (count > nroots) count = nroots;
+    for (ux i=0; i<count; i++) {
+        Obj *o = roots[i];
+        if (!o) continue;
+        if (o->color == purple && o->refc > 0) { mark_gray(o); continue; }
+        roots[i] = NULL; o->root = 0;
+        if (o->color == black && o->refc == 0) obj_free(o);
+    }
+    for (ux i=0; i<count; i++) if (roots[i]) scan(roots[i]);
+    for (ux i=0; i<count; i++) {
+        Obj *o = roots[i];
+        if (!o) continue;
+        roots[i] = NULL; o->root = 0;
+        collect_white(o);
+    }
+    ux j = 0;
+    for (ux i=count; i<nroots; i++) if (roots[i]) { roots[j] = roots[i]; roots[j]->root = j+1; j++; }
+    nroots = j;
+    stats.slices++;
+}
+
+int gc_poll(void) {
+    if (!requested) return 0;
+    pthread_mutex_lock(&lock);
+    slice(GC_SLICE);
+    requested = nroots > 0;
+    since_bytes = 0;
+    pthread_mutex_unlock(&lock);
+    return 1;
+}
+
+void gc_collect(void) {
+    pthread_mutex_lock(&lock);
+    while (nroots) slice(nroots);
+    requested = 0; since_bytes = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+void gc_stats(GcStats *s) {
+    pthread_mutex_lock(&lock);
+    *s = stats;
+    pthread_mutex_unlock(&lock);
+}
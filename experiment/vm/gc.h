@@ -0,0 +1,63 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Environments, closures and namespaces
+ * These share the Obj header and can refer to each other in cycles (a
+ * closure stored in the environment it captures), which counting alone
+ * never frees. They are collected by trial deletion (Bacon and Rajan): an
+ * object whose count drops without reaching zero is buffered as a possible
+ * root, and a collection subtracts the references inside the subgraph below
+ * each root; whatever is left at zero is garbage. References from VM
+ * stacks, imports and the REPL environment are counted like any other, so
+ * nothing has to be registered as a root. Arrays hold only arrays, so they
+ * are never buffered.
+ *
+ * Allocating objects or buffering roots raises a request once past a
+ * threshold; the interpreter calls gc_poll at a safe point with no pool
+ * workers running, and each call handles at most GC_SLICE roots so pauses
+ * stay short. gc_collect empties the buffer.
+ */
+
+#define GC_SLICE 256
+
+enum { obj_env, obj_closure, obj_ns, obj_prim, obj_train, obj_derived };  // prim: block is the glyph; train: slots f g h; derived: slots f m g
+
+// a slot holds an Arr* with its low bit set, an Obj*, or 0
+typedef uintptr_t Val;
+
+typedef struct Obj {
+    u64 refc;
+    u8  kind;
+    u8  mem;     // size class, see memory.h
+    u8  color;   // collector state
+    u32 root;    // 1 + position in the root buffer, or 0
+    u32 block;   // closures: block index; namespaces: index of the name list
+    u32 n;       // number of slots
+    struct Obj *parent;  // environment: enclosing one; closure and namespace: defining one
+    Val slot[];
+} Obj;
+
+static inline Val val_arr(Arr *a) { return (Val)a | 1; }
+static inline Val val_obj(Obj *o) { return (Val)o; }
+static inline int val_is_arr(Val v) { return v & 1; }
+static inline Arr *val_as_arr(Val v) { return (Arr*)(v & ~(Val)1); }
+static inline Obj *val_as_obj(Val v) { return (Obj*)v; }
+
+// parent is borrowed; slots start at 0
+Obj *obj_new(u8 kind, Obj *parent, u32 block, u32 n);
+void obj_set(Obj *o, u32 i, Val v);  // consumes v
+void obj_inc(Obj *o);
+void obj_dec(Obj *o);
+void val_inc(Val v);
+void val_dec(Val v);
+
+int gc_poll(void);  // 1 if a slice ran
+void gc_collect(void);
+
+typedef struct {
+    u64 slices;
+    u64 roots;   // buffered, counting each time
+    u64 freed;   // objects found in cycles
+} GcStats;
+void gc_stats(GcStats *s);
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "types.h"
+#include "log.h"
+
+typedef struct { u8 *p; ux n, cap; } Buf;
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t writer;
+    FILE *file;
+    Buf front, back;  // callers fill front; the writer drains back
+    int open, stop;
+} Log;
+
+static Log logs[LOG_MAX];
+static pthread_mutex_t table = PTHREAD_MUTEX_INITIALIZER;  // guards open flags while handles are handed out
+
+static void *drain(void *arg) {
+    Log *l = arg;
+    pthread_mutex_lock(&l->lock);
+    for (;;) {
+        while (!l->stop && l->front.n < LOG_BATCH) {
+            struct timespec t;
+            clock_gettime(CLOCK_REALTIME, &t);
+            t.tv_nsec += LOG_MS*1000000L;
+            t.tv_sec += t.tv_nsec / 1000000000L; t.tv_nsec %= 1000000000L;
+            if (pthread_cond_timedwait(&l->wake, &l->lock, &t) == ETIMEDOUT) break;
+        }
+        Buf b = l->front; l->front = l->back; l->back = b; l->front.n = 0;
+        int done = l->stop;
+        pthread_mutex_unlock(&l->lock);
+        if (l->back.n) { fwrite(l->back.p, 1, l->back.n, l->file); fflush(l->file); }
+        l->back.n = 0;
+        if (done) return NULL;
+        pthread_mutex_lock(&l->lock);
+    }
+}
+
+static Log *get(i32 h) {
+    return h >= 0 && h < LOG_MAX && logs[h].open ? &logs[h] : NULL;
+}
+
+i32 log_open(const u8 *path, u64 n) {
+    char *s = malloc(n+1);
+    memcpy(s, path, n); s[n] = 0;
+    FILE *f = fopen(s, "ab");
+    free(s);
+    if (!f) return -1;
+    pthread_mutex_lock(&table);
+    i32 h = 0;
+    while (h < LOG_MAX && logs[h].open) h++;
+    if (h == LOG_MAX) { pthread_mutex_unlock(&table); fclose(f); return -1; }
+    Log *l = &logs[h];
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->wake, NULL);
+    l->file = f; l->stop = 0; l->open = 1;
+    if (pthread_create(&l->writer, NULL, drain, l)) { l->open = 0; h = -1; fclose(f); }
+    pthread_mutex_unlock(&table);
+    return h;
+}
+
+i64 log_write(i32 h, const u8 *s, u64 n) {
+    Log *l = get(h);
+    if (!l) return -1;
+    pthread_mutex_lock(&l->lock);
+    if (l->front.n + n > l->front.cap) {
+        l->front.cap = l->front.n + n > 2*l->front.cap ? l->front.n + n : 2*l->front.cap;
+        l->front.p = realloc(l->front.p, l->front.cap);
+    }
+    memcpy(l->front.p + l->front.n, s, n);
+    l->front.n += n;
+    if (l->front.n >= LOG_BATCH) pthread_cond_signal(&l->wake);
+    pthread_mutex_unlock(&l->lock);
+    return n;
+}
+
+void log_close(i32 h) {
+    Log *l = get(h);
+    if (!l) return;
+    pthread_mutex_lock(&l->lock);
+    l->stop = 1;
+    pthread_cond_signal(&l->wake);
+    pthread_mutex_unlock(&l->lock);
+    pthread_join(l->writer, NULL);
+    fclose(l->file);
+    pthread_mutex_destroy(&l->lock);
+    pthread_cond_destroy(&l->wake);
+    pthread_mutex_lock(&table);
+    l->open = 0;
+    pthread_mutex_unlock(&table);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Asynchronous append-only writers
+ * For the debugger's event log and event trace (see src/log.bqn):
+ * log_write copies the bytes into the writer's buffer and returns, and a
+ * background thread per writer appends the buffer to its file in batches,
+ * once it passes LOG_BATCH bytes or every LOG_MS milliseconds. The buffers
+ * are swapped under a lock, so writing to the file never holds up a
+ * caller. log_close writes what's left. Up to LOG_MAX writers are open at
+ * once, each named by the handle log_open returns.
+ */
+
+#define LOG_BATCH (64<<10)
+#define LOG_MS    200
+#define LOG_MAX   8
+
+i32 log_open(const u8 *path, u64 n);         // path of n bytes, not terminated; a handle, or -1 if it can't be opened
+i64 log_write(i32 h, const u8 *s, u64 n);    // bytes taken, or -1 if h isn't open
+void log_close(i32 h);
@@ -1,7 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
 #include "types.h"
 #include "memory.h"
 
+struct ArenaChunk {
+    ArenaChunk *next;
+    ux used, size;
+    _Alignas(16) u8 data[];
+};
+
 void *arena_alloc(Arena *a, ux size) {
+    size = (size+15) & ~(ux)15;
+    ArenaChunk *c = a->head;
+    if (!c || c->used+size > c->size) {
+        ux cs = a->chunk_size ? a->chunk_size : 1<<16;
+        if (cs < size) cs = size;
+        c = malloc(sizeof(ArenaChunk) + cs);
+        if (!c) return NULL;
+        c->next = a->head; c->used = 0; c->size = cs;
+        a->head = c;
+    }
+    void *r = c->data + c->used;
+    c->used += size;
+    return r;
+}
+
+// keep the newest chunk for reuse
+void arena_reset(Arena *a) {
+    ArenaChunk *c = a->head;
+    if (!c) return;
+    ArenaChunk *n = c->next;
+    c->next = NULL; c->used = 0;
+    while (n) { ArenaChunk *t = n->next; free(n); n = t; }
+}
+
+void arena_free(Arena *a) {
+    arena_reset(a);
+    free(a->head);
+    a->head = NULL;
+}
+
+/*
+ * Slabs
+ */
+#define SLAB_BYTES (64<<10)
+
+static const u16 class_size[MEM_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+typedef struct FreeNode { struct FreeNode *next; } FreeNode;
+static _Thread_local FreeNode *free_list[MEM_CLASSES];
+static _Thread_local u8 *bump[MEM_CLASSES], *bump_end[MEM_CLASSES];
+
+// updated atomically, as any thread may allocate
+static struct { u64 allocs[MEM_CLASSES+1], frees[MEM_CLASSES+1], slabs[MEM_CLASSES]; } counts;
+#define COUNT(f, c) __atomic_fetch_add(&counts.f[c], 1, __ATOMIC_RELAXED)
+
+u8 mem_class(ux size) {
+    static const u8 by16[17] = { 0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7 };
+    return size > MEM_SMALL ? MEM_LARGE : by16[(size+15)/16];
+}
+
+void *mem_alloc(u8 cls, ux size) {
+    COUNT(allocs, cls);
+    if (cls == MEM_LARGE) return malloc(size);
+    void *p;
+    if (free_list[cls]) {
+        p = free_list[cls];
+        free_list[cls] = free_list[cls]->next;
+    } else {
+        if (bump[cls] == bump_end[cls]) {
+            ux n = SLAB_BYTES / class_size[cls] * class_size[cls];
+            if (!(bump[cls] = aligned_alloc(16, n))) return NULL;
+            bump_end[cls] = bump[cls] + n;
+            COUNT(slabs, cls);
+        }
+        p = bump[cls];
+        bump[cls] += class_size[cls];
+    }
+#ifdef MEM_POISON
+    memset(p, 0xcd, class_size[cls]);
+#endif
+    return p;
+}
 
+void mem_free(void *p, u8 cls) {
+    COUNT(frees, cls);
+    if (cls == MEM_LARGE) { free(p); return; }
+#ifdef MEM_POISON
+    memset(p, 0xdd, class_size[cls]);
+#endif
+    FreeNode *f = p;
+    f->next = free_list[cls];
+    free_list[cls] = f;
 }
 
+void mem_stats(MemStats *s) {
+    *s = (MemStats){0};
+    for (ux c=0; c<=MEM_CLASSES; c++) {
+        s->allocs[c] = __atomic_load_n(&counts.allocs[c], __ATOMIC_RELAXED);
+        s->frees[c]  = __atomic_load_n(&counts.frees[c],  __ATOMIC_RELAXED);
+        if (c == MEM_LARGE) continue;
+        s->slab_bytes += __atomic_load_n(&counts.slabs[c], __ATOMIC_RELAXED) * (SLAB_BYTES / class_size[c] * class_size[c]);
+        s->live_bytes += (s->allocs[c] - s->frees[c]) * class_size[c];
+    }
+    s->idle_bytes = s->slab_bytes - s->live_bytes;
+}
+
+void mem_stats_print(FILE *f) {
+    MemStats s;
+    mem_stats(&s);
+    fprintf(f, "%8s %12s %12s %12s\n", "class", "allocs", "frees", "live");
+    for (ux c=0; c<=MEM_CLASSES; c++) {
+        if (c < MEM_CLASSES) fprintf(f, "%8u", class_size[c]); else fprintf(f, "%8s", "large");
+        fprintf(f, " %12llu %12llu %12llu\n", (unsigned long long)s.allocs[c], (unsigned long long)s.frees[c],
+                (unsigned long long)(s.allocs[c]-s.frees[c]));
+    }
+    fprintf(f, "slabs %llu bytes, live %llu, idle %llu (%.1f%%)\n",
+            (unsigned long long)s.slab_bytes, (unsigned long long)s.live_bytes, (unsigned long long)s.idle_bytes,
+            s.slab_bytes ? 100.0*s.idle_bytes/s.slab_bytes : 0.0);
+}
+
+/*
+ * Arrays
+ */
+Arr *arr_new(u8 type, u8 rank, const ux *sh) {
+    ux ia = 1;
+    for (ux i=0; i<rank; i++) ia *= sh[i];
+    ux hd = (sizeof(Arr) + rank*sizeof(ux) + 15) & ~(ux)15;
+    ux size = hd + el_bytes(type, ia);
+    u8 cls = mem_class(size);
+    Arr *r = mem_alloc(cls, size);
+    if (!r) return NULL;
+    r->refc = 1; r->type = type; r->rank = rank; r->mem = cls; r->ia = ia;
+    r->sh = (ux*)(r+1);
+    if (rank) memcpy(r->sh, sh, rank*sizeof(ux));
+    r->data = (u8*)r + hd;
+    r->base = NULL; r->st = NULL; r->off = 0;
+    // keep the padding bits of the last word clear so word kernels can ignore the tail
+    if (type==el_bit && ia) ((u64*)r->data)[bit_words(ia)-1] = 0;
+    return r;
+}
+
+Arr *arr_vec(u8 type, ux n) { return arr_new(type, 1, &n); }
+
+void ptr_dec(Arr *x) {
+    if (__atomic_sub_fetch(&x->refc, 1, __ATOMIC_ACQ_REL)) return;
+    if (x->base) ptr_dec(x->base);  // a view's elements belong to its base
+    else if (x->type==el_arr) {
+        Arr **p = x->data;
+        for (ux i=0; i<x->ia; i++) if (p[i]) ptr_dec(p[i]);  // NULL while being filled
+    }
+    mem_free(x, x->mem);
+}
@@ -1,11 +1,45 @@
+#pragma once
+#include <stdio.h>
 #include "types.h"
 
+// bump allocator, freed all at once
+typedef struct ArenaChunk ArenaChunk;
 typedef struct  {
+    ArenaChunk *head;
+    ux chunk_size;
 } Arena;
 
 void *arena_alloc(Arena *a, ux size);
 void arena_reset(Arena *a);
 void arena_free(Arena *a);
 
+/*
+ * Small objects
+ * Sizes up to MEM_SMALL bytes come from slabs of fixed size classes, each
+ * thread keeping its own free lists; larger ones from malloc. Slabs are
+ * never returned. Building with -DMEM_POISON (make debug) fills freed
+ * memory with 0xdd and new memory with 0xcd.
+ */
+#define MEM_SMALL   256
+#define MEM_CLASSES 8
+#define MEM_LARGE   MEM_CLASSES  // class of malloc'd blocks
 
+u8 mem_class(ux size);
+void *mem_alloc(u8 cls, ux size);
+void mem_free(void *p, u8 cls);
 
+typedef struct {
+    u64 allocs[MEM_CLASSES+1], frees[MEM_CLASSES+1];  // per class, the last being malloc
+    u64 slab_bytes;  // reserved for slabs
+    u64 live_bytes;  // held by live small objects
+    u64 idle_bytes;  // in slabs but not live, whether freed or never used
+} MemStats;
+void mem_stats(MemStats *s);
+void mem_stats_print(FILE *f);
+
+// refcounted arrays; data is allocated inline after the shape
+// counts are atomic, as workers in pool.h share arrays
+Arr *arr_new(u8 type, u8 rank, const ux *sh);
+Arr *arr_vec(u8 type, ux n);
+static inline Arr *ptr_inc(Arr *x) { __atomic_fetch_add(&x->refc, 1, __ATOMIC_RELAXED); return x; }
+void ptr_dec(Arr *x);
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "types.h"
+#include "pool.h"
+
+typedef struct { ux i0, i1; } Range;
+
+// oldest ranges at head, which thieves take; the owner works at tail
+#define DEQUE_CAP 128
+typedef struct {
+    pthread_mutex_t lock;
+    ux head, tail;
+    Range q[DEQUE_CAP];
+} Deque;
+
+static struct {
+    ux n;           // workers, including the thread calling pool_for
+    Deque *dq;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, idle;
+    u64 gen;        // bumped for each job
+    ux busy;        // workers still inside the current job
+    void (*body)(void*, ux, ux);
+    void *ctx;
+    ux grain;
+    ux left;        // elements not yet finished, atomic
+} pool;
+
+// one job at a time: outside threads calling pool_for take turns
+static pthread_mutex_t job = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local int in_pool;
+
+static void push(Deque *d, Range r) {
+    pthread_mutex_lock(&d->lock);
+    if (d->tail-d->head == DEQUE_CAP) abort();
+    d->q[d->tail++ % DEQUE_CAP] = r;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static int pop(Deque *d, Range *r, int steal) {
+    pthread_mutex_lock(&d->lock);
+    int ok = d->tail != d->head;
+    if (ok) *r = steal ? d->q[d->head++ % DEQUE_CAP] : d->q[--d->tail % DEQUE_CAP];
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static int steal(ux id, Range *r) {
+    for (ux k=1; k<pool.n; k++)
+        if (pop(&pool.dq[(id+k) % pool.n], r, 1)) return 1;
+    return 0;
+}
+
+static void run_job(ux id) {
+    Deque *d = &pool.dq[id];
+    while (__atomic_load_n(&pool.left, __ATOMIC_ACQUIRE)) {
+        Range r;
+        if (!pop(d, &r, 0) && !steal(id, &r)) { sched_yield(); continue; }
+        while (r.i1-r.i0 > pool.grain) {
+            ux mid = r.i0 + (r.i1-r.i0)/2;
+            push(d, (Range){ mid, r.i1 });
+            r.i1 = mid;
+        }
+        pool.body(pool.ctx, r.i0, r.i1);
+        __atomic_fetch_sub(&pool.left, r.i1-r.i0, __ATOMIC_RELEASE);
+    }
+}
+
+static void *worker(void *arg) {
+    ux id = (ux)arg;
+    u64 seen = 0;
+    in_pool = 1;
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.gen == seen) pthread_cond_wait(&pool.wake, &pool.lock);
+        seen = pool.gen;
+        pthread_mutex_unlock(&pool.lock);
+        run_job(id);
+        pthread_mutex_lock(&pool.lock);
+        if (!--pool.busy) pthread_cond_signal(&pool.idle);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+void pool_init(ux threads) {
+    if (__atomic_load_n(&pool.n, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&init_lock);
+    if (pool.n) { pthread_mutex_unlock(&init_lock); return; }
+    if (!threads) { long c = sysconf(_SC_NPROCESSORS_ONLN); threads = c>0 ? c : 1; }
+    pool.dq = calloc(threads, sizeof(Deque));
+    for (ux i=0; i<threads; i++) pthread_mutex_init(&pool.dq[i].lock, NULL);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.wake, NULL);
+    pthread_cond_init(&pool.idle, NULL);
+    for (ux i=1; i<threads; i++) {
+        pthread_t t;
+        pthread_create(&t, NULL, worker, (void*)i);
+        pthread_detach(t);
+    }
+    __atomic_store_n(&pool.n, threads, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&init_lock);
+}
+
+ux pool_size(void) { pool_init(0); return pool.n; }
+
+void pool_for(ux n, ux min_grain, void (*body)(void *ctx, ux i0, ux i1), void *ctx) {
+    pool_init(0);
+    ux grain = n / (8*pool.n);
+    if (grain < min_grain) grain = min_grain;
+    if (grain < 1) grain = 1;
+    if (in_pool || pool.n==1 || n<=grain) { if (n) body(ctx, 0, n); return; }
+    pthread_mutex_lock(&job);
+    in_pool = 1;
+    pool.body = body; pool.ctx = ctx; pool.grain = grain;
+    __atomic_store_n(&pool.left, n, __ATOMIC_RELEASE);
+    push(&pool.dq[0], (Range){ 0, n });
+    pthread_mutex_lock(&pool.lock);
+    pool.busy = pool.n-1;
+    pool.gen++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    run_job(0);
+    // the job description is reused, so wait for every worker to leave it
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy) pthread_cond_wait(&pool.idle, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+    in_pool = 0;
+    pthread_mutex_unlock(&job);
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Thread pool
+ * Work-stealing workers: pool_for splits [0,n) in halves down to a grain
+ * that adapts to n and the number of workers, and idle workers steal the
+ * largest pending half from others. The calling thread works too, and a
+ * pool_for inside a body runs sequentially. Threads outside the pool may
+ * call pool_for at the same time; their jobs run one after another.
+ */
+
+void pool_init(ux threads);  // 0 for one per core; otherwise called on first use
+ux pool_size(void);
+void pool_for(ux n, ux min_grain, void (*body)(void *ctx, ux i0, ux i1), void *ctx);
@@ -0,0 +1,405 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <immintrin.h>
+#include "types.h"
+#include "memory.h"
+#include "bits.h"
+#include "replicate.h"
+#include "view.h"
+
+/*
+ * Compress kernels
+ * Write the elements of x selected by the mask m to r, where n is the
+ * length of x and total the number selected. Vector kernels handle whole
+ * mask words while a full word of output fits, then hand the rest to the
+ * scalar loop, so nothing is read or written out of bounds.
+ */
+typedef void (*CompressFn)(const u64 *m, const void *x, void *r, ux n, ux total);
+
+#define COMPRESS_SCALAR(T)                                                   \
+static ux compress_tail_##T(const u64 *m, const T *x, T *r, ux w, ux n, ux o, ux total) { \
+    for (; w < bit_words(n); w++) {                                         \
+        u64 v = m[w];                                                       \
+        const T *xw = x + 64*w;                                             \
+        if (o+64 <= total && __builtin_popcountll(v) > 16) {                \
+            ux e = n-64*w < 64 ? n-64*w : 64;                               \
+            for (ux i=0; i<e; i++) { r[o] = xw[i]; o += v>>i & 1; }         \
+        } else {                                                            \
+            for (; v; v&=v-1) r[o++] = xw[__builtin_ctzll(v)];              \
+        }                                                                   \
+    }                                                                       \
+    return o;                                                               \
+}                                                                           \
+static void compress_scalar_##T(const u64 *m, const void *x, void *r, ux n, ux total) { \
+    compress_tail_##T(m, x, r, 0, n, 0, total);                             \
+}
+COMPRESS_SCALAR(u8)
+COMPRESS_SCALAR(u16)
+COMPRESS_SCALAR(u32)
+COMPRESS_SCALAR(u64)
+#undef COMPRESS_SCALAR
+
+// packed bits
+static void compress_scalar_bit(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u64 *xp = x; u64 *rp = r;
+    for (ux i=0; i<bit_words(total); i++) rp[i] = 0;
+    ux o = 0;
+    for (ux w=0; w<bit_words(n); w++)
+        for (u64 v=m[w]; v; v&=v-1, o++)
+            rp[o/64] |= (xp[w]>>__builtin_ctzll(v) & 1) << (o%64);
+}
+
+__attribute__((target("bmi2")))
+static void compress_bmi2_bit(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u64 *xp = x; u64 *rp = r;
+    for (ux i=0; i<bit_words(total); i++) rp[i] = 0;
+    ux o = 0;
+    for (ux w=0; w<bit_words(n); w++) {
+        u64 b = _pext_u64(xp[w], m[w]);
+        ux c = __builtin_popcountll(m[w]);
+        if (!c) continue;
+        rp[o/64] |= b << (o%64);
+        if (o%64 + c > 64) rp[o/64+1] = b >> (64 - o%64);
+        o += c;
+    }
+}
+
+/*
+ * AVX2: permutation tables indexed by 8 (or 4) mask bits
+ */
+static u8  perm8 [256][8];   // byte shuffles for 8 bytes
+static u8  perm16[256][16];  // byte shuffles for 8 16-bit elements
+static u32 perm32[256][8];   // lane permutations for 8 32-bit elements
+static u32 perm64[16][8];    // lane permutations for 4 64-bit elements, as 32-bit pairs
+
+static void perm_init(void) {
+    for (ux k=0; k<256; k++) {
+        ux o = 0;
+        for (ux i=0; i<8; i++) if (k>>i & 1) {
+            perm8[k][o] = i;
+            perm16[k][2*o] = 2*i; perm16[k][2*o+1] = 2*i+1;
+            perm32[k][o] = i;
+            if (k<16 && i<4) { perm64[k][2*o] = 2*i; perm64[k][2*o+1] = 2*i+1; }
+            o++;
+        }
+    }
+}
+
+__attribute__((target("avx2,popcnt")))
+static void compress_avx2_u8(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u8 *xp = x; u8 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=8) {
+            u8 k = m[w]>>j;
+            __m128i v = _mm_loadl_epi64((const __m128i*)(xp + 64*w + j));
+            __m128i p = _mm_loadl_epi64((const __m128i*)perm8[k]);
+            _mm_storel_epi64((__m128i*)(rp+o), _mm_shuffle_epi8(v, p));
+            o += __builtin_popcount(k);
+        }
+    compress_tail_u8(m, xp, rp, w, n, o, total);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void compress_avx2_u16(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u16 *xp = x; u16 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=8) {
+            u8 k = m[w]>>j;
+            __m128i v = _mm_loadu_si128((const __m128i*)(xp + 64*w + j));
+            __m128i p = _mm_loadu_si128((const __m128i*)perm16[k]);
+            _mm_storeu_si128((__m128i*)(rp+o), _mm_shuffle_epi8(v, p));
+            o += __builtin_popcount(k);
+        }
+    compress_tail_u16(m, xp, rp, w, n, o, total);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void compress_avx2_u32(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u32 *xp = x; u32 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=8) {
+            u8 k = m[w]>>j;
+            __m256i v = _mm256_loadu_si256((const __m256i*)(xp + 64*w + j));
+            __m256i p = _mm256_loadu_si256((const __m256i*)perm32[k]);
+            _mm256_storeu_si256((__m256i*)(rp+o), _mm256_permutevar8x32_epi32(v, p));
+            o += __builtin_popcount(k);
+        }
+    compress_tail_u32(m, xp, rp, w, n, o, total);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void compress_avx2_u64(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u64 *xp = x; u64 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=4) {
+            u8 k = m[w]>>j & 15;
+            __m256i v = _mm256_loadu_si256((const __m256i*)(xp + 64*w + j));
+            __m256i p = _mm256_loadu_si256((const __m256i*)perm64[k]);
+            _mm256_storeu_si256((__m256i*)(rp+o), _mm256_permutevar8x32_epi32(v, p));
+            o += __builtin_popcount(k);
+        }
+    compress_tail_u64(m, xp, rp, w, n, o, total);
+}
+
+/*
+ * AVX-512: VPCOMPRESS; byte and word forms need VBMI2
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi2,popcnt")))
+static void compress_avx512_u8(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u8 *xp = x; u8 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++) {
+        __m512i v = _mm512_loadu_si512(xp + 64*w);
+        _mm512_storeu_si512(rp+o, _mm512_maskz_compress_epi8(m[w], v));
+        o += __builtin_popcountll(m[w]);
+    }
+    compress_tail_u8(m, xp, rp, w, n, o, total);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi2,popcnt")))
+static void compress_avx512_u16(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u16 *xp = x; u16 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=32) {
+            u32 k = m[w]>>j;
+            __m512i v = _mm512_loadu_si512(xp + 64*w + j);
+            _mm512_storeu_si512(rp+o, _mm512_maskz_compress_epi16(k, v));
+            o += __builtin_popcount(k);
+        }
+    compress_tail_u16(m, xp, rp, w, n, o, total);
+}
+
+__attribute__((target("avx512f,popcnt")))
+static void compress_avx512_u32(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u32 *xp = x; u32 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=16) {
+            u16 k = m[w]>>j;
+            __m512i v = _mm512_loadu_si512(xp + 64*w + j);
+            _mm512_storeu_si512(rp+o, _mm512_maskz_compress_epi32(k, v));
+            o += __builtin_popcount(k);
+        }
+    compress_tail_u32(m, xp, rp, w, n, o, total);
+}
+
+__attribute__((target("avx512f,popcnt")))
+static void compress_avx512_u64(const u64 *m, const void *x, void *r, ux n, ux total) {
+    const u64 *xp = x; u64 *rp = r;
+    ux w = 0, o = 0;
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=8) {
+            u8 k = m[w]>>j;
+            __m512i v = _mm512_loadu_si512(xp + 64*w + j);
+            _mm512_storeu_si512(rp+o, _mm512_maskz_compress_epi64(k, v));
+            o += __builtin_popcount(k);
+        }
+    compress_tail_u64(m, xp, rp, w, n, o, total);
+}
+
+/*
+ * Indices of a packed mask, as i32
+ */
+typedef void (*IndicesFn)(const u64 *m, i32 *r, ux n, ux total);
+
+static void indices_scalar(const u64 *m, i32 *r, ux n, ux total) {
+    (void)total;
+    for (ux w=0; w<bit_words(n); w++)
+        for (u64 v=m[w]; v; v&=v-1) *r++ = 64*w + __builtin_ctzll(v);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void indices_avx2(const u64 *m, i32 *r, ux n, ux total) {
+    ux w = 0, o = 0;
+    __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), eight = _mm256_set1_epi32(8);
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=8) {
+            u8 k = m[w]>>j;
+            __m256i p = _mm256_loadu_si256((const __m256i*)perm32[k]);
+            _mm256_storeu_si256((__m256i*)(r+o), _mm256_permutevar8x32_epi32(iota, p));
+            o += __builtin_popcount(k);
+            iota = _mm256_add_epi32(iota, eight);
+        }
+    for (; w<bit_words(n); w++)
+        for (u64 v=m[w]; v; v&=v-1) r[o++] = 64*w + __builtin_ctzll(v);
+}
+
+__attribute__((target("avx512f,popcnt")))
+static void indices_avx512(const u64 *m, i32 *r, ux n, ux total) {
+    ux w = 0, o = 0;
+    __m512i iota = _mm512_setr_epi32(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15), sixteen = _mm512_set1_epi32(16);
+    for (; w < n/64 && o+64 <= total; w++)
+        for (ux j=0; j<64; j+=16) {
+            u16 k = m[w]>>j;
+            _mm512_storeu_si512(r+o, _mm512_maskz_compress_epi32(k, iota));
+            o += __builtin_popcount(k);
+            iota = _mm512_add_epi32(iota, sixteen);
+        }
+    for (; w<bit_words(n); w++)
+        for (u64 v=m[w]; v; v&=v-1) r[o++] = 64*w + __builtin_ctzll(v);
+}
+
+/*
+ * Runtime selection
+ */
+static CompressFn compress_fn[5];  // by width: bit, 8, 16, 32, 64
+static IndicesFn indices_fn;
+static pthread_once_t selected = PTHREAD_ONCE_INIT;  // pool workers may make the first call
+
+static void select_kernels(void) {
+    __builtin_cpu_init();
+    int avx2 = __builtin_cpu_supports("avx2");
+    int avx512 = __builtin_cpu_supports("avx512f");
+    int vbmi2 = avx512 && __builtin_cpu_supports("avx512vbmi2") && __builtin_cpu_supports("avx512bw");
+    if (avx2) perm_init();
+    compress_fn[0] = __builtin_cpu_supports("bmi2") ? compress_bmi2_bit : compress_scalar_bit;
+    compress_fn[1] = vbmi2 ? compress_avx512_u8  : avx2 ? compress_avx2_u8  : compress_scalar_u8;
+    compress_fn[2] = vbmi2 ? compress_avx512_u16 : avx2 ? compress_avx2_u16 : compress_scalar_u16;
+    compress_fn[3] = avx512 ? compress_avx512_u32 : avx2 ? compress_avx2_u32 : compress_scalar_u32;
+    compress_fn[4] = avx512 ? compress_avx512_u64 : avx2 ? compress_avx2_u64 : compress_scalar_u64;
+    indices_fn = avx512 ? indices_avx512 : avx2 ? indices_avx2 : indices_scalar;
+}
+
+static int width_class(u8 type) {
+    switch (el_width(type)) {
+        case 0: return 0;
+        case 1: return 1;
+        case 2: return 2;
+        case 4: return 3;
+        default: return 4;
+    }
+}
+
+/*
+ * Entry points
+ */
+// boolean mask w selecting major cells of x, cells of c elements
+static Arr *replicate_mask(Arr *w, Arr *x, ux c) {
+    ux n = w->ia, total = bit_sum(w);
+    ux *sh = malloc(x->rank*sizeof(ux));
+    memcpy(sh, x->sh, x->rank*sizeof(ux));
+    sh[0] = total;
+    Arr *r = arr_new(x->type, x->rank, sh);
+    free(sh);
+    if (c==1) {
+        pthread_once(&selected, select_kernels);
+        compress_fn[width_class(x->type)](w->data, x->data, r->data, n, total);
+    } else if (x->type==el_bit) {
+        u64 *xp = x->data, *rp = r->data, *m = w->data;
+        for (ux i=0; i<bit_words(r->ia); i++) rp[i] = 0;
+        for (ux i=0, o=0; i<n; i++) if (m[i/64]>>(i%64) & 1)
+            for (ux e=i*c; e<(i+1)*c; e++, o++) rp[o/64] |= (xp[e/64]>>(e%64) & 1) << (o%64);
+    } else {
+        ux b = c*el_width(x->type);
+        u8 *xp = x->data, *rp = r->data;
+        u64 *m = w->data;
+        for (ux k=0; k<bit_words(n); k++)
+            for (u64 v=m[k]; v; v&=v-1) { memcpy(rp, xp + (64*k + __builtin_ctzll(v))*b, b); rp += b; }
+    }
+    if (x->type==el_arr) for (ux i=0; i<r->ia; i++) ptr_inc(((Arr**)r->data)[i]);
+    return r;
+}
+
+static _Thread_local int error;
+
+int replicate_error(void) { return error; }
+
+static Arr *fail(int e) { error = e; return NULL; }
+
+// counts are integers, or floats that hold integers
+static int count_type(u8 t) { return t==el_i8 || t==el_i16 || t==el_i32 || t==el_f64; }
+
+static i64 count_at(Arr *w, ux i) {
+    switch (w->type) {
+        case el_i8:  return ((i8 *)w->data)[i];
+        case el_i16: return ((i16*)w->data)[i];
+        case el_i32: return ((i32*)w->data)[i];
+        default:     return ((f64*)w->data)[i];
+    }
+}
+
+// sum of the counts, or -1 after setting error
+static i64 count_total(Arr *w) {
+    if (!count_type(w->type)) { fail(rep_type); return -1; }
+    i64 total = 0;
+    for (ux i=0; i<w->ia; i++) {
+        if (w->type==el_f64) {
+            f64 v = ((f64*)w->data)[i];
+            if (!(v>=0) || v!=floor(v) || v>=(f64)INT64_MAX) { fail(rep_range); return -1; }
+        }
+        i64 k = count_at(w, i);
+        if (k<0) { fail(rep_range); return -1; }
+        total += k;
+    }
+    return total;
+}
+
+static Arr *replicate_flat(Arr *w, Arr *x) {
+    ux n = w->ia, c = n ? x->ia/n : 0;
+    if (w->type==el_bit) return replicate_mask(w, x, c);
+    i64 total = count_total(w);
+    if (total<0) return NULL;
+    ux *sh = malloc(x->rank*sizeof(ux));
+    memcpy(sh, x->sh, x->rank*sizeof(ux));
+    sh[0] = total;
+    Arr *r = arr_new(x->type, x->rank, sh);
+    free(sh);
+    if (x->type==el_bit) {
+        u64 *xp = x->data, *rp = r->data;
+        for (ux i=0; i<bit_words(r->ia); i++) rp[i] = 0;
+        for (ux i=0, o=0; i<n; i++)
+            for (i64 k=count_at(w, i); k--; )
+                for (ux e=i*c; e<(i+1)*c; e++, o++) rp[o/64] |= (xp[e/64]>>(e%64) & 1) << (o%64);
+    } else {
+        ux b = c*el_width(x->type);
+        u8 *xp = x->data, *rp = r->data;
+        for (ux i=0; i<n; i++)
+            for (i64 k=count_at(w, i); k--; rp += b) memcpy(rp, xp + i*b, b);
+        if (x->type==el_arr) for (ux i=0; i<r->ia; i++) ptr_inc(((Arr**)r->data)[i]);
+    }
+    return r;
+}
+
+static Arr *indices_flat(Arr *x) {
+    if (x->type==el_bit) {
+        if (x->ia > INT32_MAX) return bit_indices(x);
+        pthread_once(&selected, select_kernels);
+        ux total = bit_sum(x);
+        Arr *r = arr_vec(el_i32, total);
+        indices_fn(x->data, r->data, x->ia, total);
+        return r;
+    }
+    ux n = x->ia;
+    i64 total = count_total(x);
+    if (total<0) return NULL;
+    Arr *r = arr_vec(el_i32, total);
+    i32 *rp = r->data;
+    for (ux i=0; i<n; i++)
+        for (i64 k=count_at(x, i); k--; ) *rp++ = i;
+    return r;
+}
+
+Arr *replicate(Arr *w, Arr *x) {
+    error = rep_ok;
+    if (w->rank!=1 || !x->rank || w->ia!=x->sh[0]) return fail(rep_length);
+    w = arr_flat(w); x = arr_flat(x);
+    Arr *r = replicate_flat(w, x);
+    ptr_dec(w); ptr_dec(x);
+    return r;
+}
+
+Arr *indices(Arr *x) {
+    error = rep_ok;
+    if (x->rank!=1) return fail(rep_rank);
+    x = arr_flat(x);
+    Arr *r = indices_flat(x);
+    ptr_dec(x);
+    return r;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Replicate and Indices
+ * Arguments are borrowed; NULL is returned on error, and replicate_error
+ * tells which. Counts are booleans, integers, or floats holding integers.
+ * Boolean masks select elements with compress kernels for element widths
+ * of 1, 8, 16, 32 and 64 bits, using AVX-512, AVX2 shuffle tables or BMI2
+ * when the CPU has them and a scalar loop otherwise.
+ */
+
+Arr *replicate(Arr *w, Arr *x);  // w/x, with w boolean or integer
+Arr *indices(Arr *x);            // /x
+
+// why the last call on this thread returned NULL
+enum { rep_ok, rep_length, rep_rank, rep_range, rep_type };  // range: a count isn't a natural number
+int replicate_error(void);
@@ -0,0 +1,401 @@
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "memory.h"
+#include "search.h"
+#include "view.h"
+
+/*
+ * Canonical keys
+ * Every element becomes a u64 so that equal elements have equal keys.
+ * With only integer and character types, integers are kept as they are
+ * and characters are offset past the i32 range. Otherwise numbers are
+ * their f64 bits with ¯0 and NaN normalized, characters use NaN payloads
+ * that normalization never produces, and nested elements are hashed.
+ */
+enum { key_int, key_flt };
+
+static int key_mode(Arr *w, Arr *x) {
+    return w->type==el_f64 || w->type==el_arr || x->type==el_f64 || x->type==el_arr ? key_flt : key_int;
+}
+
+static u64 mix(u64 h) {
+    h ^= h>>33; h *= 0xff51afd7ed558ccdull;
+    h ^= h>>33; h *= 0xc4ceb9fe1a85ec53ull;
+    return h ^ h>>33;
+}
+
+static u64 num_key(f64 v) {
+    if (v==0) v = 0;
+    if (v!=v) return 0x7ff8000000000000ull;
+    u64 b; memcpy(&b, &v, 8);
+    return b;
+}
+
+static u64 char_key(u32 c, int mode) {
+    return mode==key_int ? ((u64)1<<40) + c : 0x7ff4000000000000ull | c;
+}
+
+static u64 deep_hash(Arr *a);
+
+static u64 el_key(Arr *x, ux i, int mode) {
+    i64 v;
+    switch (x->type) {
+        case el_bit: v = ((u64*)x->data)[i/64]>>(i%64) & 1; break;
+        case el_i8:  v = ((i8 *)x->data)[i]; break;
+        case el_i16: v = ((i16*)x->data)[i]; break;
+        case el_i32: v = ((i32*)x->data)[i]; break;
+        case el_f64: return num_key(((f64*)x->data)[i]);
+        case el_c8:  return char_key(((u8 *)x->data)[i], mode);
+        case el_c16: return char_key(((u16*)x->data)[i], mode);
+        case el_c32: return char_key(((u32*)x->data)[i], mode);
+        default:     return deep_hash(((Arr**)x->data)[i]);
+    }
+    return mode==key_int ? (u64)v : num_key(v);
+}
+
+static u64 deep_hash(Arr *a) {
+    a = arr_flat(a);
+    u64 h = mix(0x5bd1e995 + a->rank);
+    for (ux i=0; i<a->rank; i++) h = mix(h ^ a->sh[i]);
+    for (ux i=0; i<a->ia; i++) h = mix(h ^ el_key(a, i, key_flt));
+    ptr_dec(a);
+    return h;
+}
+
+static int deep_match(Arr *a, Arr *b);
+
+static int el_match(Arr *a, ux i, Arr *b, ux j) {
+    int na = a->type==el_arr, nb = b->type==el_arr;
+    if (na || nb) return na && nb && deep_match(((Arr**)a->data)[i], ((Arr**)b->data)[j]);
+    return el_key(a, i, key_flt) == el_key(b, j, key_flt);
+}
+
+static int deep_match(Arr *a, Arr *b) {
+    if (a->rank!=b->rank || memcmp(a->sh, b->sh, a->rank*sizeof(ux))) return 0;
+    a = arr_flat(a); b = arr_flat(b);
+    int m = 1;
+    for (ux i=0; m && i<a->ia; i++) m = el_match(a, i, b, i);
+    ptr_dec(a); ptr_dec(b);
+    return m;
+}
+
+// keys for n cells of c elements each
+typedef struct {
+    Arr *x;
+    u64 *k;
+    ux n, c;
+    int exact;  // key equality is element equality: flat scalar cells
+} Keys;
+
+static Keys keys_load(Arr *x, ux n, ux c, int mode) {
+    Keys r = { x, malloc(x->ia*sizeof(u64) + 1), n, c, 0 };
+    for (ux i=0; i<x->ia; i++) r.k[i] = el_key(x, i, mode);
+    r.exact = c==1 && x->type!=el_arr;
+    return r;
+}
+
+static u64 cell_hash(Keys *a, ux i) {
+    u64 *k = a->k + i*a->c;
+    if (a->c==1) return mix(k[0]);
+    u64 h = 0;
+    for (ux j=0; j<a->c; j++) h = mix(h ^ k[j]);
+    return h;
+}
+
+static int cell_eq(Keys *a, ux i, Keys *b, ux j) {
+    ux c = a->c;
+    if (memcmp(a->k + i*c, b->k + j*c, c*sizeof(u64))) return 0;
+    if (a->x->type!=el_arr && b->x->type!=el_arr) return 1;
+    for (ux e=0; e<c; e++) if (!el_match(a->x, i*c+e, b->x, j*c+e)) return 0;
+    return 1;
+}
+
+/*
+ * Strategies
+ */
+#define LINEAR_MAX 16          // tables this short are scanned
+#define SORT_MIN   (1<<25)     // tables this long are sorted, as hash probes would miss cache anyway
+
+// direct tables cover at most this many values
+static ux direct_max(ux n) { return 4*n + 65536; }
+
+static int direct_range(Keys *a, Keys *b, int mode, i64 *min, ux *range) {
+    if (mode!=key_int || !a->exact || (b && !b->exact)) return 0;
+    i64 lo = INT64_MAX, hi = INT64_MIN;
+    for (ux i=0; i<a->n; i++) { i64 v = a->k[i]; if (v<lo) lo = v; if (v>hi) hi = v; }
+    if (b) for (ux i=0; i<b->n; i++) { i64 v = b->k[i]; if (v<lo) lo = v; if (v>hi) hi = v; }
+    if (hi<lo || (u64)(hi-lo) >= direct_max(a->n + (b ? b->n : 0))) return 0;
+    *min = lo; *range = hi-lo+1;
+    return 1;
+}
+
+// LSD radix grade of keys by bytes; stable
+static i32 *grade_keys(u64 *k, ux n) {
+    ux (*c)[256] = calloc(8, sizeof *c);
+    for (ux i=0; i<n; i++)
+        for (int p=0; p<8; p++) c[p][k[i]>>(8*p) & 0xff]++;
+    i32 *ra = malloc(n*sizeof(i32)), *rb = malloc(n*sizeof(i32));
+    for (ux i=0; i<n; i++) ra[i] = i;
+    for (int p=0; p<8; p++) {
+        ux *cp = c[p], s = 0;
+        if (cp[k[0]>>(8*p) & 0xff] == n) continue;
+        for (ux b=0; b<256; b++) { ux t = cp[b]; cp[b] = s; s += t; }
+        for (ux i=0; i<n; i++) rb[cp[k[ra[i]]>>(8*p) & 0xff]++] = ra[i];
+        i32 *t = ra; ra = rb; rb = t;
+    }
+    free(rb); free(c);
+    return ra;
+}
+
+typedef struct { u64 key; i64 ix; } Slot;
+
+static ux table_cap(ux n) { ux c = 16; while (c < 2*n) c *= 2; return c; }
+
+// probe for cell i of a in table s built from t; returns the slot
+// slots hold raw keys if exact, which must be the same for building and probing
+static Slot *probe(Slot *s, ux mask, Keys *t, Keys *a, ux i, int exact) {
+    if (exact) {
+        u64 k = a->k[i];
+        for (ux p = mix(k)&mask; ; p = (p+1)&mask)
+            if (s[p].ix<0 || s[p].key==k) return s+p;
+    }
+    u64 h = cell_hash(a, i);
+    for (ux p = h&mask; ; p = (p+1)&mask)
+        if (s[p].ix<0 || (s[p].key==h && cell_eq(t, s[p].ix, a, i))) return s+p;
+}
+
+static Slot *table_new(ux cap) {
+    Slot *s = malloc(cap*sizeof(Slot));
+    for (ux i=0; i<cap; i++) s[i].ix = -1;
+    return s;
+}
+
+static u64 slot_key(Keys *t, ux i, int exact) { return exact ? t->k[i] : cell_hash(t, i); }
+
+// r[i] is the index of the first cell of t matching cell i of q, or t->n
+static void lookup(Keys *t, Keys *q, int mode, i32 *r) {
+    ux n = t->n, m = q->n;
+    i64 min; ux range;
+    if (direct_range(t, q, mode, &min, &range)) {
+        i32 *d = malloc(range*sizeof(i32));
+        for (ux v=0; v<range; v++) d[v] = n;
+        for (ux i=n; i--; ) d[(i64)t->k[i]-min] = i;
+        for (ux i=0; i<m; i++) r[i] = d[(i64)q->k[i]-min];
+        free(d);
+    } else if (n <= LINEAR_MAX) {
+        for (ux i=0; i<m; i++) {
+            ux j = 0;
+            while (j<n && !cell_eq(t, j, q, i)) j++;
+            r[i] = j;
+        }
+    } else if (n >= SORT_MIN && t->exact && q->exact) {
+        i32 *gt = grade_keys(t->k, n), *gq = grade_keys(q->k, m);
+        for (ux i=0, j=0; i<m; i++) {
+            u64 k = q->k[gq[i]];
+            while (j<n && t->k[gt[j]]<k) j++;
+            r[gq[i]] = j<n && t->k[gt[j]]==k ? gt[j] : (i32)n;
+        }
+        free(gt); free(gq);
+    } else {
+        ux cap = table_cap(n);
+        Slot *s = table_new(cap);
+        int exact = t->exact && q->exact;
+        for (ux i=0; i<n; i++) {
+            Slot *p = probe(s, cap-1, t, t, i, exact);
+            if (p->ix<0) { p->key = slot_key(t, i, exact); p->ix = i; }
+        }
+        for (ux i=0; i<m; i++) {
+            Slot *p = probe(s, cap-1, t, q, i, exact);
+            r[i] = p->ix<0 ? (i32)n : p->ix;
+        }
+        free(s);
+    }
+}
+
+// r[i] is the index of cell i's first occurrence in order of first occurrences
+static void classify_keys(Keys *a, int mode, i32 *r) {
+    ux n = a->n;
+    i32 u = 0;
+    i64 min; ux range;
+    if (direct_range(a, NULL, mode, &min, &range)) {
+        i32 *d = malloc(range*sizeof(i32));
+        for (ux v=0; v<range; v++) d[v] = -1;
+        for (ux i=0; i<n; i++) {
+            i32 *e = d + ((i64)a->k[i]-min);
+            if (*e<0) *e = u++;
+            r[i] = *e;
+        }
+        free(d);
+    } else if (n <= LINEAR_MAX) {
+        for (ux i=0; i<n; i++) {
+            ux j = 0;
+            while (j<i && !cell_eq(a, j, a, i)) j++;
+            r[i] = j<i ? r[j] : u++;
+        }
+    } else if (n >= SORT_MIN && a->exact) {
+        // groups of equal keys are contiguous in the grade and start at their first occurrence
+        i32 *g = grade_keys(a->k, n), *first = malloc(n*sizeof(i32));
+        for (ux i=0; i<n; i++) r[i] = 0;
+        for (ux i=0, f=0; i<n; i++) {
+            if (i==0 || a->k[g[i]]!=a->k[g[i-1]]) { f = g[i]; r[f] = 1; }
+            first[g[i]] = f;
+        }
+        for (ux i=0; i<n; i++) { i32 t = r[i]; r[i] = u; u += t; }
+        for (ux i=0; i<n; i++) r[i] = r[first[i]];
+        free(g); free(first);
+    } else {
+        ux cap = table_cap(n);
+        Slot *s = table_new(cap);
+        for (ux i=0; i<n; i++) {
+            Slot *p = probe(s, cap-1, a, a, i, a->exact);
+            if (p->ix<0) { p->key = slot_key(a, i, a->exact); p->ix = i; r[i] = u++; }
+            else r[i] = r[p->ix];
+        }
+        free(s);
+    }
+}
+
+/*
+ * Entry points
+ */
+static ux shape_prod(ux *sh, ux n) {
+    ux c = 1;
+    for (ux i=0; i<n; i++) c *= sh[i];
+    return c;
+}
+
+// look up cells of x with the shape of major cells of w; NULL if shapes don't fit
+static Arr *search(Arr *w, Arr *x) {
+    ux cr = w->rank-1, lr = x->rank-cr;
+    if (!w->rank || x->rank<cr || memcmp(w->sh+1, x->sh+lr, cr*sizeof(ux))) return NULL;
+    w = arr_flat(w); x = arr_flat(x);
+    int mode = key_mode(w, x);
+    ux c = shape_prod(w->sh+1, cr);
+    Keys t = keys_load(w, w->sh[0], c, mode), q = keys_load(x, shape_prod(x->sh, lr), c, mode);
+    Arr *r = arr_new(el_i32, lr, x->sh);
+    lookup(&t, &q, mode, r->data);
+    free(t.k); free(q.k);
+    ptr_dec(w); ptr_dec(x);
+    return r;
+}
+
+// ids of the major cells of x; NULL for an atom
+static Arr *classify_cells(Arr *x) {
+    if (!x->rank) return NULL;
+    x = arr_flat(x);
+    ux n = x->sh[0];
+    Keys a = keys_load(x, n, shape_prod(x->sh+1, x->rank-1), key_mode(x, x));
+    Arr *r = arr_vec(el_i32, n);
+    classify_keys(&a, key_mode(x, x), r->data);
+    free(a.k);
+    ptr_dec(x);
+    return r;
+}
+
+Arr *index_of(Arr *w, Arr *x) { return search(w, x); }
+
+Arr *member_of(Arr *w, Arr *x) {
+    Arr *i = search(x, w);
+    if (!i) return NULL;
+    Arr *r = arr_new(el_bit, i->rank, i->sh);
+    i32 *ip = i->data; u64 *rp = r->data;
+    ux n = x->sh[0];
+    for (ux j=0; j<bit_words(i->ia); j++) rp[j] = 0;
+    for (ux j=0; j<i->ia; j++) rp[j/64] |= (u64)((ux)ip[j]<n) << (j%64);
+    ptr_dec(i);
+    return r;
+}
+
+// the k-th match of a cell class in x takes the k-th cell of that class in w
+Arr *progressive_index_of(Arr *w, Arr *x) {
+    Arr *i = search(w, x);
+    if (!i) return NULL;
+    Arr *c = classify_cells(w);
+    ux n = w->sh[0];
+    i32 *ip = i->data, *cp = c->data;
+    // positions of each class in w, grouped by class
+    ux u = 0;
+    for (ux j=0; j<n; j++) if ((ux)cp[j]==u) u++;
+    ux *start = calloc(u+1, sizeof(ux));
+    for (ux j=0; j<n; j++) start[cp[j]+1]++;
+    for (ux k=0; k<u; k++) start[k+1] += start[k];
+    ux *next = malloc((u+1)*sizeof(ux)), *pos = malloc(n*sizeof(ux) + 1);
+    memcpy(next, start, (u+1)*sizeof(ux));
+    for (ux j=0; j<n; j++) pos[next[cp[j]]++] = j;
+    memcpy(next, start, u*sizeof(ux));
+    for (ux j=0; j<i->ia; j++) {
+        if ((ux)ip[j]==n) continue;
+        ux k = cp[ip[j]];
+        ip[j] = next[k]<start[k+1] ? (i32)pos[next[k]++] : (i32)n;
+    }
+    free(start); free(next); free(pos);
+    ptr_dec(c);
+    return i;
+}
+
+Arr *classify(Arr *x) { return classify_cells(x); }
+
+Arr *mark_firsts(Arr *x) {
+    Arr *c = classify_cells(x);
+    if (!c) return NULL;
+    Arr *r = arr_vec(el_bit, c->ia);
+    i32 *cp = c->data; u64 *rp = r->data;
+    for (ux j=0; j<bit_words(c->ia); j++) rp[j] = 0;
+    for (ux j=0, u=0; j<c->ia; j++)
+        if ((ux)cp[j]==u) { rp[j/64] |= (u64)1<<(j%64); u++; }
+    ptr_dec(c);
+    return r;
+}
+
+Arr *deduplicate(Arr *x) {
+    Arr *c = classify_cells(x);
+    if (!c) return NULL;
+    x = arr_flat(x);
+    i32 *cp = c->data;
+    ux u = 0;
+    for (ux j=0; j<c->ia; j++) if ((ux)cp[j]==u) u++;
+    ux *sh = malloc(x->rank*sizeof(ux));
+    memcpy(sh, x->sh, x->rank*sizeof(ux));
+    sh[0] = u;
+    Arr *r = arr_new(x->type, x->rank, sh);
+    free(sh);
+    ux cell = shape_prod(x->sh+1, x->rank-1);
+    if (x->type==el_bit) {
+        u64 *xp = x->data, *rp = r->data;
+        for (ux j=0; j<bit_words(r->ia); j++) rp[j] = 0;
+        for (ux j=0, k=0, o=0; j<c->ia; j++) {
+            if ((ux)cp[j]!=k) continue;
+            k++;
+            for (ux e=0; e<cell; e++, o++) {
+                ux i = j*cell + e;
+                rp[o/64] |= (xp[i/64]>>(i%64) & 1) << (o%64);
+            }
+        }
+    } else {
+        ux w = el_width(x->type)*cell;
+        u8 *o = r->data;
+        for (ux j=0, k=0; j<c->ia; j++)
+            if ((ux)cp[j]==k) { memcpy(o, (u8*)x->data + j*w, w); o += w; k++; }
+        if (x->type==el_arr) for (ux j=0; j<r->ia; j++) ptr_inc(((Arr**)r->data)[j]);
+    }
+    ptr_dec(c); ptr_dec(x);
+    return r;
+}
+
+Arr *group_by_key(Arr *x) {
+    Arr *c = classify_cells(x);
+    if (!c) return NULL;
+    i32 *cp = c->data;
+    ux u = 0;
+    for (ux j=0; j<c->ia; j++) if ((ux)cp[j]==u) u++;
+    ux *len = calloc(u+1, sizeof(ux));
+    for (ux j=0; j<c->ia; j++) len[cp[j]]++;
+    Arr *r = arr_vec(el_arr, u);
+    Arr **rp = r->data;
+    for (ux k=0; k<u; k++) { rp[k] = arr_vec(el_i32, len[k]); len[k] = 0; }
+    for (ux j=0; j<c->ia; j++) ((i32*)rp[cp[j]]->data)[len[cp[j]]++] = j;
+    free(len);
+    ptr_dec(c);
+    return r;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Search functions
+ * Arguments are borrowed. Searches look for major cells of the table in
+ * cells of the same rank in the other argument, and return NULL if the
+ * trailing shapes don't match. Indices are i32.
+ * Lookups use a direct table for small-range integers and characters,
+ * a linear scan for short tables, sorting for very large ones, and an
+ * open-addressing hash table otherwise.
+ */
+
+Arr *index_of(Arr *w, Arr *x);     // w⊐x
+Arr *member_of(Arr *w, Arr *x);    // w∊x, as el_bit
+Arr *progressive_index_of(Arr *w, Arr *x);  // w⊒x
+Arr *classify(Arr *x);             // ⊐x
+Arr *mark_firsts(Arr *x);          // ∊x, as el_bit
+Arr *deduplicate(Arr *x);          // ⍷x
+Arr *group_by_key(Arr *x);         // ⊔⊐x: list of index lists, ordered by first appearance
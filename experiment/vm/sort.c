@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "memory.h"
+#include "sort.h"
+#include "view.h"
+
+/*
+ * Integer keys
+ * Every element of a small type maps to an unsigned key with the same
+ * ordering, complemented for a descending grade.
+ */
+static int radix_type(u8 t) {
+    return t==el_bit || t==el_i8 || t==el_i16 || t==el_i32 || t==el_c8 || t==el_c16;
+}
+
+static u32 key_max(u8 t) {
+    return t==el_bit ? 1 : (u32)((((u64)1)<<(8*el_width(t)))-1);
+}
+
+static u32 *load_keys(Arr *x, int down, u32 *min, u32 *max) {
+    ux n = x->ia;
+    u32 *k = malloc(n*sizeof(u32) + 1);
+    u32 m = key_max(x->type);
+    switch (x->type) {
+        case el_bit: for (ux i=0; i<n; i++) k[i] = ((u64*)x->data)[i/64]>>(i%64) & 1; break;
+        case el_i8:  for (ux i=0; i<n; i++) k[i] = (u32)(((i8 *)x->data)[i] + 0x80);   break;
+        case el_i16: for (ux i=0; i<n; i++) k[i] = (u32)(((i16*)x->data)[i] + 0x8000); break;
+        case el_i32: for (ux i=0; i<n; i++) k[i] = (u32)((i32*)x->data)[i] ^ 0x80000000u; break;
+        case el_c8:  for (ux i=0; i<n; i++) k[i] = ((u8 *)x->data)[i]; break;
+        case el_c16: for (ux i=0; i<n; i++) k[i] = ((u16*)x->data)[i]; break;
+    }
+    u32 lo = m, hi = 0;
+    for (ux i=0; i<n; i++) {
+        if (down) k[i] = m - k[i];
+        if (k[i]<lo) lo = k[i];
+        if (k[i]>hi) hi = k[i];
+    }
+    *min = lo; *max = hi;
+    return k;
+}
+
+// write key k of type t back as an element of r at position i
+static void store_key(Arr *r, ux i, u32 k, int down) {
+    if (down) k = key_max(r->type) - k;
+    switch (r->type) {
+        case el_bit: if (k) ((u64*)r->data)[i/64] |= (u64)1<<(i%64); break;
+        case el_i8:  ((i8 *)r->data)[i] = (i8)((i32)k - 0x80);   break;
+        case el_i16: ((i16*)r->data)[i] = (i16)((i32)k - 0x8000); break;
+        case el_i32: ((i32*)r->data)[i] = (i32)(k ^ 0x80000000u); break;
+        case el_c8:  ((u8 *)r->data)[i] = k; break;
+        case el_c16: ((u16*)r->data)[i] = k; break;
+    }
+}
+
+// counting sort is used while the count table is no bigger than this
+static int use_counting(ux n, u32 range) { return range <= 2*n + 256; }
+
+static void grade_count(u32 *k, ux n, u32 min, ux range, i32 *r) {
+    ux *c = calloc(range+1, sizeof(ux));
+    for (ux i=0; i<n; i++) c[k[i]-min+1]++;
+    for (ux b=1; b<range; b++) c[b] += c[b-1];
+    for (ux i=0; i<n; i++) r[c[k[i]-min]++] = i;
+    free(c);
+}
+
+// LSD radix on bytes, reordering the keys k and, if r isn't NULL, the indices r
+// passes where every key has the same byte are skipped
+static void radix(u32 *k, i32 *r, ux n, int bytes) {
+    ux (*c)[256] = calloc(bytes, sizeof *c);
+    for (ux i=0; i<n; i++)
+        for (int p=0; p<bytes; p++) c[p][k[i]>>(8*p) & 0xff]++;
+    u32 *ka = k, *kb = malloc(n*sizeof(u32));
+    i32 *ra = r, *rb = r ? malloc(n*sizeof(i32)) : NULL;
+    for (int p=0; p<bytes; p++) {
+        ux *cp = c[p], s = 0;
+        if (cp[ka[0]>>(8*p) & 0xff] == n) continue;
+        for (ux b=0; b<256; b++) { ux t = cp[b]; cp[b] = s; s += t; }
+        for (ux i=0; i<n; i++) {
+            ux j = cp[ka[i]>>(8*p) & 0xff]++;
+            kb[j] = ka[i];
+            if (r) rb[j] = ra[i];
+        }
+        u32 *tk = ka; ka = kb; kb = tk;
+        i32 *tr = ra; ra = rb; rb = tr;
+    }
+    if (ka != k) { memcpy(k, ka, n*sizeof(u32)); kb = ka; }
+    if (r && ra != r) { memcpy(r, ra, n*sizeof(i32)); rb = ra; }
+    free(kb); free(rb); free(c);
+}
+
+/*
+ * Comparison fallback
+ * Stable merge sort of indices; major cells compare lexicographically,
+ * numbers before characters before arrays.
+ */
+static int el_class(u8 t) { return t>=el_c8 && t<=el_c32 ? 1 : t==el_arr ? 2 : 0; }
+
+static f64 el_num(Arr *x, ux i) {
+    switch (x->type) {
+        case el_bit: return ((u64*)x->data)[i/64]>>(i%64) & 1;
+        case el_i8:  return ((i8 *)x->data)[i];
+        case el_i16: return ((i16*)x->data)[i];
+        case el_i32: return ((i32*)x->data)[i];
+        case el_f64: return ((f64*)x->data)[i];
+        case el_c8:  return ((u8 *)x->data)[i];
+        case el_c16: return ((u16*)x->data)[i];
+        case el_c32: return ((u32*)x->data)[i];
+    }
+    return 0;
+}
+
+static int arr_cmp(Arr *a, ux ai, Arr *b, ux bi, ux n);
+
+static int el_cmp(Arr *a, ux i, Arr *b, ux j) {
+    int ca = el_class(a->type), cb = el_class(b->type);
+    if (ca != cb) return ca<cb ? -1 : 1;
+    if (ca == 2) {
+        Arr *x = arr_flat(((Arr**)a->data)[i]), *y = arr_flat(((Arr**)b->data)[j]);
+        ux n = x->ia<y->ia ? x->ia : y->ia;
+        int c = arr_cmp(x, 0, y, 0, n);
+        if (!c) c = (x->ia>y->ia) - (x->ia<y->ia);
+        ptr_dec(x); ptr_dec(y);
+        return c;
+    }
+    f64 u = el_num(a, i), v = el_num(b, j);
+    return (u>v) - (u<v);
+}
+
+static int arr_cmp(Arr *a, ux ai, Arr *b, ux bi, ux n) {
+    for (ux i=0; i<n; i++) {
+        int c = el_cmp(a, ai+i, b, bi+i);
+        if (c) return c;
+    }
+    return 0;
+}
+
+static void merge_sort(Arr *x, ux cell, int down, i32 *r, i32 *t, ux n) {
+    if (n < 2) return;
+    ux h = n/2;
+    merge_sort(x, cell, down, r, t, h);
+    merge_sort(x, cell, down, r+h, t, n-h);
+    ux i = 0, j = h, o = 0;
+    while (i<h && j<n) {
+        int c = arr_cmp(x, r[j]*cell, x, r[i]*cell, cell);
+        t[o++] = (down ? c>0 : c<0) ? r[j++] : r[i++];
+    }
+    while (i<h) t[o++] = r[i++];
+    while (j<n) t[o++] = r[j++];
+    memcpy(r, t, n*sizeof(i32));
+}
+
+Arr *grade_cmp(Arr *x, int down) {
+    x = arr_flat(x);
+    ux n = x->rank ? x->sh[0] : 1;
+    ux cell = n ? x->ia/n : 0;
+    Arr *r = arr_vec(el_i32, n);
+    i32 *rp = r->data, *t = malloc(n*sizeof(i32) + 1);
+    for (ux i=0; i<n; i++) rp[i] = i;
+    merge_sort(x, cell, down, rp, t, n);
+    free(t);
+    ptr_dec(x);
+    return r;
+}
+
+/*
+ * Entry points
+ */
+static Arr *grade(Arr *x, int down) {
+    ux n = x->ia;
+    if (x->rank!=1 || !radix_type(x->type) || n<16) return grade_cmp(x, down);
+    x = arr_flat(x);
+    Arr *r = arr_vec(el_i32, n);
+    u32 min, max;
+    u32 *k = load_keys(x, down, &min, &max);
+    if (use_counting(n, max-min)) grade_count(k, n, min, (ux)(max-min)+1, r->data);
+    else {
+        i32 *rp = r->data;
+        for (ux i=0; i<n; i++) rp[i] = i;
+        radix(k, rp, n, el_width(x->type));
+    }
+    free(k);
+    ptr_dec(x);
+    return r;
+}
+
+static Arr *sort(Arr *x, int down) {
+    x = arr_flat(x);
+    ux n = x->ia;
+    if (x->rank!=1 || !radix_type(x->type) || n<16) {
+        Arr *g = grade_cmp(x, down);
+        ux cell = x->rank && x->sh[0] ? n/x->sh[0] : 1;
+        Arr *r = arr_new(x->type, x->rank, x->sh);
+        i32 *gp = g->data;
+        if (x->type==el_bit) {
+            memset(r->data, 0, el_bytes(el_bit, n));
+            for (ux i=0, o=0; i<g->ia; i++)
+                for (ux e=gp[i]*cell; e<(gp[i]+1)*cell; e++, o++)
+                    if (el_num(x, e)) ((u64*)r->data)[o/64] |= (u64)1<<(o%64);
+        } else {
+            ux w = el_width(x->type)*cell;
+            for (ux i=0; i<g->ia; i++) memcpy((u8*)r->data + i*w, (u8*)x->data + gp[i]*w, w);
+            if (x->type==el_arr) for (ux i=0; i<n; i++) ptr_inc(((Arr**)r->data)[i]);
+        }
+        ptr_dec(g); ptr_dec(x);
+        return r;
+    }
+    Arr *r = arr_new(x->type, 1, x->sh);
+    if (x->type==el_bit) memset(r->data, 0, el_bytes(el_bit, n));
+    u32 min, max;
+    u32 *k = load_keys(x, down, &min, &max);
+    if (use_counting(n, max-min)) {
+        ux range = (ux)(max-min)+1;
+        ux *c = calloc(range, sizeof(ux));
+        for (ux i=0; i<n; i++) c[k[i]-min]++;
+        for (ux b=0, i=0; b<range; b++)
+            for (ux e=i+c[b]; i<e; i++) store_key(r, i, min+b, down);
+        free(c);
+    } else {
+        radix(k, NULL, n, el_width(x->type));
+        for (ux i=0; i<n; i++) store_key(r, i, k[i], down);
+    }
+    free(k);
+    ptr_dec(x);
+    return r;
+}
+
+Arr *grade_up(Arr *x)   { return grade(x, 0); }
+Arr *grade_down(Arr *x) { return grade(x, 1); }
+Arr *sort_up(Arr *x)    { return sort(x, 0); }
+Arr *sort_down(Arr *x)  { return sort(x, 1); }
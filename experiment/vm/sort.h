@@ -0,0 +1,19 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Grade and sort
+ * Arguments are borrowed. Grades are i32 and stable, so the argument
+ * must have fewer than 2^31 elements.
+ * i8/i16/i32/c8/c16 and bit data use counting sort when the range is small
+ * compared to the length and LSD radix sort otherwise; everything else is
+ * compared with a merge sort, as are lists shorter than 16.
+ */
+
+Arr *grade_up(Arr *x);    // ⍋x
+Arr *grade_down(Arr *x);  // ⍒x
+Arr *sort_up(Arr *x);     // ∧x
+Arr *sort_down(Arr *x);   // ∨x
+
+// comparison grade for any type, used as the fallback and by benchmarks
+Arr *grade_cmp(Arr *x, int down);
@@ -0,0 +1,659 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "types.h"
+#include "memory.h"
+#include "bits.h"
+#include "sort.h"
+#include "search.h"
+#include "replicate.h"
+#include "view.h"
+#include "pool.h"
+#include "apply.h"
+#include "arith.h"
+#include "gc.h"
+#include "utf8.h"
+#include "token.h"
+#include "aot.h"
+#include "log.h"
+
+// usage: tests; prints each failed check and exits with 1 if there were any
+// Expected results are BQN's, with the expression in the comment above each check.
+
+static int checks, fails;
+#define CHECK(c) check(c, #c, __LINE__)
+static void check(int ok, const char *what, int line) {
+    checks++;
+    if (ok) return;
+    fails++;
+    printf("test.c:%d: failed: %s\n", line, what);
+}
+
+/*
+ * Arrays from literals
+ * LIST(type, ...) builds a list of that type, numbers or code points;
+ * IS(x, ...) checks that x is a list with those elements.
+ */
+#define NUMS(...) (sizeof((f64[]){__VA_ARGS__})/sizeof(f64)), (f64[]){__VA_ARGS__}
+#define LIST(t, ...) list(t, NUMS(__VA_ARGS__))
+#define IS(x, ...) is(x, NUMS(__VA_ARGS__))
+
+static f64 at(Arr *x, ux i) {
+    switch (x->type) {
+        case el_bit: return ((u64*)x->data)[i/64]>>(i%64) & 1;
+        case el_i8:  return ((i8 *)x->data)[i];
+        case el_i16: return ((i16*)x->data)[i];
+        case el_i32: return ((i32*)x->data)[i];
+        case el_f64: return ((f64*)x->data)[i];
+        case el_c8:  return ((u8 *)x->data)[i];
+        case el_c16: return ((u16*)x->data)[i];
+        case el_c32: return ((u32*)x->data)[i];
+    }
+    return NAN;
+}
+
+static void put(Arr *x, ux i, f64 v) {
+    switch (x->type) {
+        case el_bit: if (v) ((u64*)x->data)[i/64] |= (u64)1<<(i%64); else ((u64*)x->data)[i/64] &= ~((u64)1<<(i%64)); break;
+        case el_i8:  ((i8 *)x->data)[i] = v; break;
+        case el_i16: ((i16*)x->data)[i] = v; break;
+        case el_i32: ((i32*)x->data)[i] = v; break;
+        case el_f64: ((f64*)x->data)[i] = v; break;
+        case el_c8:  ((u8 *)x->data)[i] = v; break;
+        case el_c16: ((u16*)x->data)[i] = v; break;
+        case el_c32: ((u32*)x->data)[i] = v; break;
+    }
+}
+
+static Arr *list(u8 type, ux n, const f64 *v) {
+    Arr *r = arr_vec(type, n);
+    for (ux i=0; i<n; i++) put(r, i, v[i]);
+    return r;
+}
+
+// sh⥊x into a new array, consuming x
+static Arr *shape(Arr *x, u8 rank, const ux *sh) {
+    Arr *r = arr_new(x->type, rank, sh);
+    for (ux i=0; i<r->ia; i++) put(r, i, at(x, i));
+    ptr_dec(x);
+    return r;
+}
+
+// consumes x
+static int is(Arr *x, ux n, const f64 *v) {
+    if (!x) return 0;
+    int ok = x->ia==n;
+    Arr *f = arr_flat(x);
+    for (ux i=0; ok && i<n; i++) ok = at(f, i)==v[i] || (v[i]!=v[i] && at(f, i)!=at(f, i));
+    ptr_dec(f); ptr_dec(x);
+    return ok;
+}
+
+// ↕n as type
+static Arr *iota(u8 type, ux n) {
+    Arr *r = arr_vec(type, n);
+    for (ux i=0; i<n; i++) put(r, i, i);
+    return r;
+}
+
+static int shape_is(Arr *x, u8 rank, const ux *sh) {
+    return x && x->rank==rank && !memcmp(x->sh, sh, rank*sizeof(ux));
+}
+
+/*
+ * Boolean kernels
+ */
+static void test_bits(void) {
+    Arr *a = bit_pack(LIST(el_i8, 1,0,1,1,0)), *b = bit_pack(LIST(el_i8, 0,0,1,0,1));
+    CHECK(IS(bit_unpack(a), 1,0,1,1,0));
+    CHECK(IS(bit_and(a, b), 0,0,1,0,0));     // a∧b
+    CHECK(IS(bit_or(a, b), 1,0,1,1,1));      // a∨b
+    CHECK(IS(bit_xor(a, b), 1,0,0,1,1));     // a≠b
+    CHECK(IS(bit_andnot(a, b), 1,0,0,1,0));  // a>b
+    CHECK(IS(bit_not(a), 0,1,0,0,1));        // ¬a
+    CHECK(bit_sum(a)==3);                    // +´a
+    CHECK(IS(bit_indices(a), 0,2,3));        // /a
+    ptr_dec(a); ptr_dec(b);
+
+    // across words: x←100↑(70⥊0)∾1‿0‿1
+    Arr *x = arr_vec(el_bit, 100);
+    for (ux i=0; i<100; i++) put(x, i, i==70 || i==72);
+    Arr *nx = bit_not(x);
+    Arr *o = bit_scan_or(x), *n = bit_scan_and(nx), *p = bit_scan_xor(x);
+    int ok = 1;
+    for (ux i=0; i<100; i++) {
+        ok &= at(o, i) == (i>=70);                // ∨`x
+        ok &= at(n, i) == (i<70);                 // ∧`¬x
+        ok &= at(p, i) == (i==70 || i==71);       // ≠`x
+    }
+    CHECK(ok);
+    CHECK(bit_sum(o)==30);                        // tail bits stay clear
+    ptr_dec(x); ptr_dec(nx); ptr_dec(o); ptr_dec(n); ptr_dec(p);
+
+    Arr *w = LIST(el_i32, 1,5,0,-2), *v = LIST(el_i32, 1,4,0,3);
+    CHECK(IS(bit_cmp(cmp_eq, w, v), 1,0,1,0));   // 1‿5‿0‿¯2 = 1‿4‿0‿3
+    CHECK(IS(bit_cmp(cmp_lt, w, v), 0,0,0,1));   // <
+    CHECK(IS(bit_cmp(cmp_ge, w, v), 1,1,1,0));   // ≥
+    ptr_dec(w); ptr_dec(v);
+}
+
+/*
+ * Grade and sort
+ */
+static void test_sort(void) {
+    Arr *x = LIST(el_i8, 3,1,2,1,0);
+    CHECK(IS(grade_up(x), 4,1,3,2,0));           // ⍋3‿1‿2‿1‿0
+    CHECK(IS(grade_down(x), 0,2,1,3,4));         // ⍒3‿1‿2‿1‿0
+    CHECK(IS(sort_up(x), 0,1,1,2,3));            // ∧
+    CHECK(IS(sort_down(x), 3,2,1,1,0));          // ∨
+    ptr_dec(x);
+
+    // counting and radix paths, against the comparison grade
+    static const struct { u8 type; i64 range; } cases[] = {
+        { el_i8, 256 }, { el_i16, 65536 }, { el_i32, 100 }, { el_i32, 4000000000 }, { el_c16, 65536 },
+    };
+    for (ux c=0; c<sizeof cases/sizeof *cases; c++) {
+        x = arr_vec(cases[c].type, 1000);
+        srand(c);
+        for (ux i=0; i<1000; i++) {
+            i64 v = ((i64)rand()<<16 ^ rand()) % cases[c].range;
+            put(x, i, cases[c].type>=el_c8 ? v : v - cases[c].range/2);
+        }
+        for (int down=0; down<2; down++) {
+            Arr *g = down ? grade_down(x) : grade_up(x), *e = grade_cmp(x, down);
+            Arr *s = down ? sort_down(x) : sort_up(x);
+            int ok = !memcmp(g->data, e->data, 1000*sizeof(i32));
+            for (ux i=0; i<1000; i++) ok &= at(s, i) == at(x, ((i32*)e->data)[i]);
+            CHECK(ok);
+            ptr_dec(g); ptr_dec(e); ptr_dec(s);
+        }
+        ptr_dec(x);
+    }
+
+    // booleans: ⍋ and ∧ of 40⥊0‿1‿1
+    x = arr_vec(el_bit, 40);
+    for (ux i=0; i<40; i++) put(x, i, i%3 != 0);
+    Arr *g = grade_up(x), *s = sort_up(x);
+    int ok = 1;
+    for (ux i=0; i<40; i++) ok &= at(s, i) == (i>=14) && at(x, ((i32*)g->data)[i]) == at(s, i);
+    CHECK(ok);
+    ptr_dec(x); ptr_dec(g); ptr_dec(s);
+
+    // cells compare lexicographically: ⍋3‿2⥊2‿1‿1‿5‿1‿2
+    x = shape(LIST(el_f64, 2,1, 1,5, 1,2), 2, (ux[]){3,2});
+    CHECK(IS(grade_up(x), 2,1,0));
+    CHECK(IS(sort_up(x), 1,2, 1,5, 2,1));        // ∧
+    ptr_dec(x);
+
+    // boolean cells: ∧3‿2⥊1‿1‿0‿1‿1‿0
+    x = shape(LIST(el_bit, 1,1, 0,1, 1,0), 2, (ux[]){3,2});
+    CHECK(IS(sort_up(x), 0,1, 1,0, 1,1));
+    CHECK(IS(sort_down(x), 1,1, 1,0, 0,1));      // ∨
+    ptr_dec(x);
+}
+
+/*
+ * Search functions
+ */
+static void test_search(void) {
+    Arr *w = LIST(el_i32, 5,3,5,7), *x = LIST(el_i32, 7,5,1);
+    CHECK(IS(index_of(w, x), 3,0,4));            // 5‿3‿5‿7 ⊐ 7‿5‿1
+    CHECK(IS(member_of(x, w), 1,1,0));           // 7‿5‿1 ∊ 5‿3‿5‿7
+    CHECK(IS(progressive_index_of(w, LIST(el_i32, 5,5,5)), 0,2,4));  // 5‿3‿5‿7 ⊒ 5‿5‿5
+    CHECK(IS(classify(w), 0,1,0,2));             // ⊐
+    CHECK(IS(mark_firsts(w), 1,1,0,1));          // ∊
+    CHECK(IS(deduplicate(w), 5,3,7));            // ⍷
+    Arr *g = group_by_key(w);                    // ⊔⊐ gives ⟨0‿2, ⟨1⟩, ⟨3⟩⟩
+    CHECK(g->ia==3);
+    CHECK(IS(ptr_inc(((Arr**)g->data)[0]), 0,2));
+    CHECK(IS(ptr_inc(((Arr**)g->data)[2]), 3));
+    ptr_dec(g); ptr_dec(w); ptr_dec(x);
+
+    // ¯0 matches 0 and NaN matches NaN; characters never match numbers
+    w = LIST(el_f64, 0.5, -0.0, NAN, 97);
+    x = LIST(el_f64, 0, NAN, 0.5);
+    CHECK(IS(index_of(w, x), 1,2,0));
+    Arr *c = LIST(el_c8, 'a');
+    CHECK(IS(index_of(w, c), 4));                // 0.5‿¯0‿NaN‿97 ⊐ "a"
+    ptr_dec(w); ptr_dec(x); ptr_dec(c);
+
+    // hash table: tables past the linear scan, with a range too wide to index
+    w = arr_vec(el_f64, 1000); x = arr_vec(el_f64, 3);
+    for (ux i=0; i<1000; i++) put(w, i, 1e9*(i%500) + 0.5);
+    put(x, 0, 1e9*499 + 0.5); put(x, 1, 3); put(x, 2, 0.5);
+    CHECK(IS(index_of(w, x), 499,1000,0));
+    Arr *k = classify(w);
+    int ok = 1;
+    for (ux i=0; i<1000; i++) ok &= at(k, i) == i%500;
+    CHECK(ok);
+    ptr_dec(k); ptr_dec(w); ptr_dec(x);
+
+    // flat and nested sides hash alike: (20⥊↕2)⊐⟨0‿1, 5‿6⟩ and (⋈⟜(1⊸+)¨↕20)⊐⟨0‿1, 5‿6⟩
+    w = arr_vec(el_f64, 20);
+    for (ux i=0; i<20; i++) put(w, i, i%2);
+    Arr *v = arr_vec(el_arr, 20);
+    for (ux i=0; i<20; i++) ((Arr**)v->data)[i] = LIST(el_i32, i, i+1);
+    x = arr_vec(el_arr, 2);
+    ((Arr**)x->data)[0] = LIST(el_i8, 0,1);
+    ((Arr**)x->data)[1] = LIST(el_i32, 5,6);
+    CHECK(IS(index_of(w, x), 20,20));
+    CHECK(IS(index_of(v, x), 0,5));
+    CHECK(IS(index_of(v, w), 20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20,20));
+    ptr_dec(w); ptr_dec(v); ptr_dec(x);
+
+    // cells: (3‿2⥊1‿2‿3‿4‿1‿2) ⊐ 2‿2⥊3‿4‿9‿9
+    w = shape(LIST(el_i16, 1,2,3,4,1,2), 2, (ux[]){3,2});
+    x = shape(LIST(el_i16, 3,4,9,9), 2, (ux[]){2,2});
+    CHECK(IS(index_of(w, x), 1,3));
+    CHECK(IS(classify(w), 0,1,0));
+    CHECK(IS(deduplicate(w), 1,2,3,4));
+    Arr *y = LIST(el_i16, 1,2,3);
+    CHECK(!index_of(w, y));                      // cells of 2 can't be found in a list of 3
+    ptr_dec(w); ptr_dec(x); ptr_dec(y);
+}
+
+/*
+ * Replicate and Indices
+ */
+static void test_replicate(void) {
+    CHECK(IS(replicate(LIST(el_i8, 2,0,1), LIST(el_c8, 'a','b','c')), 'a','a','c'));  // 2‿0‿1/"abc"
+    CHECK(IS(indices(LIST(el_i32, 0,2,1)), 1,1,2));                                 // /0‿2‿1
+    CHECK(IS(replicate(LIST(el_f64, 1,2), LIST(el_i8, 5,6)), 5,6,6));              // 1‿2.0/5‿6
+    CHECK(!replicate(LIST(el_i8, 1,-1), LIST(el_i8, 1,2)) && replicate_error()==rep_range);   // negative count
+    CHECK(!indices(LIST(el_f64, 0.5)) && replicate_error()==rep_range);                       // /⟨0.5⟩
+    CHECK(!indices(LIST(el_c8, 'a')) && replicate_error()==rep_type);                         // /"a"
+    CHECK(!replicate(LIST(el_i8, 1), LIST(el_i8, 1,2)) && replicate_error()==rep_length);     // length mismatch
+
+    // masks over every element width, long enough for the vector kernels: (3|↕n)/↕n
+    static const u8 types[] = { el_bit, el_i8, el_i16, el_i32, el_f64 };
+    for (ux t=0; t<sizeof types; t++)
+        for (ux n=1; n<1000; n=3*n+7) {
+            Arr *m = arr_vec(el_bit, n), *x = arr_vec(types[t], n);
+            for (ux i=0; i<n; i++) { put(m, i, i%3 != 0); put(x, i, types[t]==el_bit ? i%5==0 : (i%100)); }
+            Arr *r = replicate(m, x), *ix = indices(m);
+            int ok = r && r->ia == n - (n+2)/3 && ix->ia == r->ia;
+            for (ux i=0, o=0; ok && i<n; i++) if (i%3) { ok = at(r, o) == at(x, i) && at(ix, o) == i; o++; }
+            CHECK(ok);
+            ptr_dec(m); ptr_dec(x); ptr_dec(r); ptr_dec(ix);
+        }
+
+    // major cells: 1‿0‿1/3‿2⥊↕6
+    Arr *x = shape(iota(el_i32, 6), 2, (ux[]){3,2});
+    Arr *r = replicate(bit_pack(LIST(el_i8, 1,0,1)), x);
+    CHECK(shape_is(r, 2, (ux[]){2,2}));
+    CHECK(IS(r, 0,1,4,5));
+    ptr_dec(x);
+}
+
+/*
+ * Views
+ */
+static void test_view(void) {
+    Arr *x = shape(iota(el_i32, 6), 2, (ux[]){2,3});
+    Arr *t = view_transpose(x);
+    CHECK(shape_is(t, 2, (ux[]){3,2}));
+    CHECK(IS(ptr_inc(t), 0,3,1,4,2,5));          // ⍉2‿3⥊↕6
+    Arr *r = view_reverse(t);
+    CHECK(IS(r, 2,5,1,4,0,3));                   // ⌽⍉
+    CHECK(IS(view_take(t, -2), 1,4,2,5));        // ¯2↑⍉
+    CHECK(IS(view_drop(t, 1), 1,4,2,5));         // 1↓⍉
+    CHECK(IS(view_cell(t, 1), 1,4));             // 1⊏⍉
+    CHECK(IS(view_reshape(t, 1, (ux[]){6}), 0,3,1,4,2,5));  // ⥊⍉
+    CHECK(!view_reshape(t, 1, (ux[]){5}));
+    Arr *f = arr_flat(t);
+    CHECK(t->st && !f->st && IS(f, 0,3,1,4,2,5));   // the view itself is left as it was
+    ptr_dec(t);
+
+    // overtaking pads with fills: 5↑1‿2‿3, ¯4↑"ab", 3↑1‿2⥊5‿6, ¯3↑⟨1⟩
+    CHECK(IS(view_take(LIST(el_i8, 1,2,3), 5), 1,2,3,0,0));
+    CHECK(IS(view_take(LIST(el_c16, 'a','b'), -4), ' ',' ','a','b'));
+    Arr *o = view_take(shape(LIST(el_f64, 5,6), 2, (ux[]){1,2}), 3);
+    CHECK(shape_is(o, 2, (ux[]){3,2}));
+    CHECK(IS(o, 5,6,0,0,0,0));
+    CHECK(IS(view_take(bit_pack(LIST(el_i8, 1)), -3), 0,0,1));
+    // 3↑⟨"ab"⟩ is ⟨"ab", "  ", "  "⟩
+    Arr *nx = arr_vec(el_arr, 1);
+    ((Arr**)nx->data)[0] = LIST(el_c8, 'a','b');
+    o = view_take(nx, 3);
+    CHECK(o->ia==3 && IS(ptr_inc(((Arr**)o->data)[2]), ' ',' ') && IS(ptr_inc(((Arr**)o->data)[0]), 'a','b'));
+    ptr_dec(o); ptr_dec(nx);
+
+    // kernels read views: +´⌽↕5, and ∧ of a transposed view
+    Arr *v = view_reverse(iota(el_i32, 5));
+    CHECK(IS(reduce_arith(op_add, v), 10));
+    CHECK(IS(sort_up(v), 0,1,2,3,4));
+    ptr_dec(v);
+    ptr_dec(x);
+
+    // boolean views: ⌽ and 1↓ of 70⥊1‿0
+    Arr *b = arr_vec(el_bit, 70);
+    for (ux i=0; i<70; i++) put(b, i, i%2==0);
+    Arr *br = view_reverse(b), *bd = view_drop(b, 1);
+    CHECK(bit_sum(br)==35 && bit_sum(bd)==34);
+    ptr_dec(br); ptr_dec(bd); ptr_dec(b);
+}
+
+/*
+ * Each, Table and folds
+ */
+static Arr *add_call(Fn *f, Arr *w, Arr *x) {
+    (void)f;
+    x = arr_flat(x); w = w ? arr_flat(w) : NULL;
+    Arr *r = arr_new(el_f64, 0, NULL);
+    *(f64*)r->data = (w ? at(w, 0) : 0) + at(x, 0);
+    ptr_dec(x); if (w) ptr_dec(w);
+    return r;
+}
+
+static void sum_body(void *ctx, ux i0, ux i1) {
+    for (ux i=i0; i<i1; i++) __atomic_fetch_add((u64*)ctx, i, __ATOMIC_RELAXED);
+}
+// 100 pool_for calls summing ↕20000 into *arg
+static void *sum_jobs(void *arg) {
+    *(u64*)arg = 0;
+    for (int k=0; k<100; k++) pool_for(20000, 1, sum_body, arg);
+    return NULL;
+}
+
+static void test_apply(void) {
+    Fn add = { add_call, 1, 1, NULL };
+    ux n = 20000;
+    Arr *x = iota(el_i32, n);
+    Arr *e = each(&add, x, x);                   // x+¨x
+    int ok = e && e->ia == n;
+    for (ux i=0; ok && i<n; i++) ok = at(((Arr**)e->data)[i], 0) == 2.0*i;
+    CHECK(ok);
+    ptr_dec(e);
+
+    Arr *f = fold(&add, x);                      // +´↕20000
+    CHECK(f && at(f, 0) == (f64)n*(n-1)/2);
+    if (f) ptr_dec(f);
+    CHECK(!fold(&add, arr_vec(el_i32, 0)));      // +´⟨⟩ has no identity here
+
+    Arr *w = LIST(el_i32, 10,20);
+    Arr *t = table(&add, w, LIST(el_i32, 1,2,3));  // 10‿20 +⌜ 1‿2‿3
+    CHECK(shape_is(t, 2, (ux[]){2,3}));
+    ok = 1;
+    for (ux i=0; i<6; i++) ok &= at(((Arr**)t->data)[i], 0) == 10*(1+i/3) + 1+i%3;
+    CHECK(ok);
+    ptr_dec(t); ptr_dec(w);
+
+    Arr *m = iota(el_i32, 5);
+    CHECK(IS(insert(&add, m), 10));              // +˝↕5
+    ptr_dec(m); ptr_dec(x);
+
+    // two threads outside the pool running jobs at once
+    pthread_t th[2];
+    u64 sums[2];
+    for (int k=0; k<2; k++) pthread_create(&th[k], NULL, sum_jobs, &sums[k]);
+    for (int k=0; k<2; k++) pthread_join(th[k], NULL);
+    CHECK(sums[0] == 100*(u64)n*(n-1)/2 && sums[1] == sums[0]);
+}
+
+/*
+ * Reductions and scans
+ */
+static void test_arith(void) {
+    Arr *x = LIST(el_i16, 3,-1,4,1,-5);
+    CHECK(IS(reduce_arith(op_add, x), 2));       // +´
+    CHECK(IS(reduce_arith(op_max, x), 4));       // ⌈´
+    CHECK(IS(reduce_arith(op_min, x), -5));      // ⌊´
+    CHECK(IS(scan_arith(op_add, x), 3,2,6,7,2)); // +`
+    CHECK(IS(scan_arith(op_max, x), 3,3,4,4,4)); // ⌈`
+    CHECK(IS(scan_arith(op_min, x), 3,-1,-1,-1,-5));  // ⌊`
+    ptr_dec(x);
+
+    x = arr_vec(el_i32, 0);
+    CHECK(IS(reduce_arith(op_add, x), 0));       // +´⟨⟩
+    CHECK(IS(reduce_arith(op_max, x), -INFINITY));  // ⌈´⟨⟩
+    CHECK(IS(reduce_arith(op_min, x), INFINITY));   // ⌊´⟨⟩
+    ptr_dec(x);
+
+    Arr *b = bit_pack(LIST(el_i8, 1,1,0,1));
+    CHECK(IS(reduce_arith(op_add, b), 3));       // +´
+    CHECK(IS(reduce_arith(op_and, b), 0));       // ∧´
+    CHECK(IS(reduce_arith(op_or, b), 1));        // ∨´
+    CHECK(IS(scan_arith(op_add, b), 1,2,2,3));   // +`
+    CHECK(IS(scan_arith(op_and, b), 1,1,0,0));   // ∧`
+    ptr_dec(b);
+    b = arr_vec(el_bit, 0);
+    CHECK(IS(reduce_arith(op_min, b), INFINITY));   // ⌊´0⥊1
+    CHECK(IS(reduce_arith(op_max, b), -INFINITY));  // ⌈´0⥊1
+    CHECK(IS(reduce_arith(op_and, b), 1));          // ∧´0⥊1
+    CHECK(IS(reduce_arith(op_or, b), 0));           // ∨´0⥊1
+    ptr_dec(b);
+
+    // many blocks: +´ and +` of ↕n are exact whatever the thread count
+    ux n = 300000;
+    x = iota(el_i32, n);
+    CHECK(IS(reduce_arith(op_add, x), (f64)n*(n-1)/2));
+    Arr *s = scan_arith(op_add, x);
+    CHECK(s->type == el_f64 && at(s, n-1) == (f64)n*(n-1)/2 && at(s, 1000) == 500500);
+    ptr_dec(s); ptr_dec(x);
+    x = arr_vec(el_f64, n);
+    for (ux i=0; i<n; i++) put(x, i, 0.5);
+    CHECK(IS(reduce_arith(op_add, x), n/2.0));
+    ptr_dec(x);
+
+    // f64 +` carries: each partial sum adds one element to the last, even
+    // across the blocks of 1<<16
+    x = arr_vec(el_f64, n);
+    for (ux i=0; i<n; i++) put(x, i, 1/(f64)(i+3));
+    s = scan_arith(op_add, x);
+    CHECK(at(s, 65536) == at(s, 65535) + at(x, 65536) && at(s, 196608) == at(s, 196607) + at(x, 196608));
+    ptr_dec(s); ptr_dec(x);
+    x = LIST(el_f64, -0.0);
+    for (int m=0; m<2; m++) {  // +`⟨¯0⟩ is ⟨¯0⟩ in both modes
+        arith_fsum_mode(m ? fsum_sequential : fsum_pairwise);
+        s = scan_arith(op_add, x);
+        CHECK(signbit(at(s, 0)));
+        ptr_dec(s);
+    }
+    arith_fsum_mode(fsum_pairwise);
+    ptr_dec(x);
+    x = LIST(el_i8, 100,100,-128);  // i8 to i32 and to i8
+    CHECK(IS(scan_arith(op_add, x), 100,200,72));
+    s = scan_arith(op_max, x);
+    CHECK(s->type == el_i8 && IS(s, 100,100,100));
+    ptr_dec(x);
+}
+
+/*
+ * Allocation and collection
+ */
+static void test_memory(void) {
+    MemStats a, b;
+    mem_stats(&a);
+    void *p[100];
+    for (ux i=0; i<100; i++) p[i] = mem_alloc(mem_class(40), 40);
+    for (ux i=0; i<100; i++) mem_free(p[i], mem_class(40));
+    void *q = mem_alloc(mem_class(40), 40);
+    CHECK(q == p[99]);                           // freed blocks are reused first
+    mem_free(q, mem_class(40));
+    mem_stats(&b);
+    CHECK(b.allocs[2] - a.allocs[2] == 101 && b.frees[2] - a.frees[2] == 101);
+    CHECK(mem_class(256) == 7 && mem_class(257) == MEM_LARGE);
+
+    Arena ar = { NULL, 1024 };
+    u8 *x = arena_alloc(&ar, 10), *y = arena_alloc(&ar, 2000);
+    CHECK(x && y && ((uintptr_t)x & 15) == 0 && ((uintptr_t)y & 15) == 0);
+    arena_free(&ar);
+
+    // an environment holding a closure that captures it: F←{F} in a block
+    GcStats s0, s1;
+    gc_stats(&s0);
+    Obj *env = obj_new(obj_env, NULL, 0, 1);
+    Obj *f = obj_new(obj_closure, env, 1, 0);
+    obj_set(env, 0, val_obj(f));
+    obj_dec(env);                                // only the cycle holds it now
+    gc_collect();
+    gc_stats(&s1);
+    CHECK(s1.freed - s0.freed == 2);
+
+    // nothing held from outside is freed
+    env = obj_new(obj_env, NULL, 0, 1);
+    f = obj_new(obj_closure, env, 1, 0);
+    obj_set(env, 0, val_obj(f));
+    obj_inc(f);
+    obj_dec(env);
+    gc_collect();
+    gc_stats(&s0);
+    CHECK(s0.freed == s1.freed);
+    obj_dec(f);
+    gc_collect();
+    gc_stats(&s1);
+    CHECK(s1.freed - s0.freed == 2);
+}
+
+/*
+ * UTF-8 and the tokenizer
+ */
+static void test_text(void) {
+    const u8 s[] = "a\xc3\xa9\xe2\x8a\x91\xf0\x9d\x95\xa9";  // "aé⊑𝕩"
+    u32 r[16]; u8 back[64];
+    CHECK(utf8_validate(s, 10) == 4);
+    CHECK(utf8_to_utf32(s, 10, r) == 4 && r[0]=='a' && r[1]==0xe9 && r[2]==0x2291 && r[3]==0x1d569);
+    CHECK(utf32_to_utf8(r, 4, back) == 10 && !memcmp(back, s, 10));
+    CHECK(utf8_validate((const u8*)"ab\xc0\x80", 4) == -1-2);         // overlong
+    CHECK(utf8_validate((const u8*)"\xed\xa0\x80", 3) == -1-0);       // surrogate
+    CHECK(utf8_complete(s, 9) == 6 && utf8_complete(s, 10) == 10 && utf8_complete(s, 2) == 1);
+
+    // long ASCII runs go through the vector path
+    u8 big[300];
+    for (ux i=0; i<300; i++) big[i] = 'a' + i%26;
+    big[257] = 0xe9;
+    CHECK(utf8_validate(big, 256) == 256 && utf8_validate(big, 300) == -1-257);
+
+    const u32 set[] = { 'a', 'b', '+', 0x1d569 };
+    u32 src[] = { 'a', '+', 0x1d569, 'b', 'a', 'a', 'a', 'a', 'b', 'b' };
+    i32 c[10];
+    CHECK(tok_classify(src, 10, set, 4, c) == 10 && c[0]==0 && c[1]==2 && c[2]==3 && c[9]==1);
+    src[6] = 'z';
+    CHECK(tok_classify(src, 10, set, 4, c) == -1-6);
+
+    // a←'#' # "x"  with an unclosed "
+    const char *q = "a←'#' # \"x\"\n\"";
+    u32 qs[16]; u8 qa[16], qb[16];
+    ux n = 0;
+    for (const char *p = q; *p; ) { u8 b = *p; if (b < 0x80) { qs[n++] = b; p++; } else { qs[n++] = 0x2190; p += 3; } }
+    tok_quotes(qs, n, qa, qb);
+    CHECK(qa[2] && qb[4] && qa[6] && qb[11] && !qa[8] && !qa[12]);
+}
+
+/*
+ * Ahead-of-time runtime: the C src/aot.bqn gives for 2×3+4
+ */
+static Val body_0(AotFrame *f) {
+    Val s0, s1, s2, s3, s4, s5;
+    AT(0); s0 = aot_const(f, 0);
+    AT(2); s1 = aot_const(f, 3);
+    AT(4); s2 = aot_const(f, 1);
+    AT(6); s3 = aot_call2(f, s2, s1, s0);
+    AT(7); s4 = aot_const(f, 4);
+    AT(9); s5 = aot_const(f, 2);
+    AT(11); s0 = aot_call2(f, s5, s4, s3);
+    AT(12); return s0;
+}
+static void consts_0(Val *c) {
+    c[0] = aot_num(4); c[1] = aot_num(3); c[2] = aot_num(2);
+    c[3] = aot_prim(U'+'); c[4] = aot_prim(U'×');
+}
+static const u32 loc_0[13] = { 0 };
+static const AotBody bodies_0[] = { { body_0, 0 } };
+static const u32 block_bodies_0[] = { 0 };
+static const AotBlock blocks_0[] = { { 0, 1, 0, 1, 0 } };
+static const AotProgram program_0 = { bodies_0, blocks_0, block_bodies_0, 5, consts_0, loc_0, loc_0 };
+
+// -´⍋3‿1‿2, through a kernel and a modifier; then ⊔, which isn't native
+static Val body_1(AotFrame *f) {
+    Val s0, s1, s2;
+    AT(0); s0 = aot_const(f, 2);
+    AT(2); s1 = aot_const(f, 1);
+    AT(4); s2 = aot_const(f, 0);
+    AT(6); s0 = aot_list(f, 3, (Val[]){s2, s1, s0});
+    AT(8); s1 = aot_const(f, 3);
+    AT(10); s0 = aot_call1(f, s1, s0);
+    AT(11); s1 = aot_const(f, 5);
+    AT(13); s2 = aot_const(f, 4);
+    AT(15); s1 = aot_mod1(f, s2, s1);
+    AT(16); s0 = aot_call1(f, s1, s0);
+    AT(17); return s0;
+}
+static Val body_2(AotFrame *f) {
+    Val s0, s1;
+    AT(0); s0 = aot_const(f, 0);
+    AT(2); s1 = aot_const(f, 6);
+    AT(4); s0 = aot_call1(f, s1, s0);
+    AT(5); return s0;
+}
+static void consts_1(Val *c) {
+    c[0] = aot_num(3); c[1] = aot_num(1); c[2] = aot_num(2);
+    c[3] = aot_prim(U'⍋'); c[4] = aot_prim(U'-'); c[5] = aot_prim(U'´'); c[6] = aot_prim(U'⊔');
+}
+static const u32 loc_1[18] = { 0 };
+static const AotBody bodies_1[] = { { body_1, 0 } }, bodies_2[] = { { body_2, 0 } };
+static const AotProgram program_1 = { bodies_1, blocks_0, block_bodies_0, 7, consts_1, loc_1, loc_1 };
+static const AotProgram program_2 = { bodies_2, blocks_0, block_bodies_0, 7, consts_1, loc_1, loc_1 };
+
+static void test_aot(void) {
+    f64 r[3];
+    CHECK(aot_run(&program_0) == 0);
+    CHECK(aot_result_kind() == 0 && aot_result_rank() == 0);
+    CHECK(aot_result(r, 1) == 1 && r[0] == 14);
+    CHECK(aot_run(&program_1) == 0);
+    CHECK(aot_result(r, 1) == 1 && r[0] == -1);  // 1-(2-0)
+    CHECK(aot_run(&program_2) == -1 && aot_error_unsupported());
+    CHECK(aot_run(&program_0) == 0 && !aot_error_unsupported());
+}
+
+/*
+ * Event log writers
+ */
+// file at path holds the n bytes want; removes it
+static int file_is(const char *path, const char *want, ux n) {
+    char got[256] = { 0 };
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    ux k = fread(got, 1, sizeof got - 1, f);
+    fclose(f);
+    remove(path);
+    return k == n && !memcmp(got, want, n);
+}
+
+static void test_log(void) {
+    const char *a = "tests.a.log", *b = "tests.b.log";
+    remove(a); remove(b);
+    i32 ha = log_open((const u8*)a, strlen(a)), hb = log_open((const u8*)b, strlen(b));
+    CHECK(ha >= 0 && hb >= 0 && ha != hb);
+    CHECK(log_write(ha, (const u8*)"one\n", 4) == 4);
+    CHECK(log_write(hb, (const u8*)"\0\1", 2) == 2);
+    CHECK(log_write(ha, (const u8*)"two\n", 4) == 4);
+    log_close(ha); log_close(hb);
+    CHECK(log_write(ha, (const u8*)"x", 1) == -1);  // closed
+    CHECK(file_is(a, "one\ntwo\n", 8));
+    CHECK(file_is(b, "\0\1", 2));
+    // reopening appends
+    ha = log_open((const u8*)a, strlen(a));
+    log_write(ha, (const u8*)"x", 1); log_close(ha);
+    ha = log_open((const u8*)a, strlen(a));
+    log_write(ha, (const u8*)"y", 1); log_close(ha);
+    CHECK(file_is(a, "xy", 2));
+}
+
+int main(void) {
+    test_bits();
+    test_sort();
+    test_search();
+    test_replicate();
+    test_view();
+    test_apply();
+    test_arith();
+    test_memory();
+    test_text();
+    test_aot();
+    test_log();
+    printf("%d checks, %d failed\n", checks, fails);
+    return fails != 0;
+}
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "types.h"
+#include "token.h"
+
+/*
+ * Classification
+ * A direct table covers the basic plane; the few characters past it
+ * (𝕩 and the like) are found by binary search. AVX2 gathers the table
+ * for eight characters at a time.
+ */
+#define BMP 0x10000
+
+static i32 *table;
+static u32 *astral; static i32 *astral_ix; static ux nastral;
+static u32 *last_set; static u64 last_m;
+
+static int load_set(const u32 *set, u64 m) {
+    if (last_set && last_m == m && !memcmp(last_set, set, m*sizeof(u32))) return 1;
+    if (!table && !(table = malloc(BMP*sizeof(i32)))) return 0;
+    free(last_set); free(astral); free(astral_ix);
+    last_set = malloc(m*sizeof(u32)); astral = malloc(m*sizeof(u32)); astral_ix = malloc(m*sizeof(i32));
+    if (!last_set || !astral || !astral_ix) { free(last_set); last_set = NULL; return 0; }
+    memcpy(last_set, set, m*sizeof(u32)); last_m = m;
+    memset(table, 0xff, BMP*sizeof(i32));
+    nastral = 0;
+    for (u64 i=0; i<m; i++) {
+        if (set[i] < BMP) { table[set[i]] = i; continue; }
+        ux j = nastral++;  // insertion keeps astral sorted
+        for (; j && astral[j-1] > set[i]; j--) { astral[j] = astral[j-1]; astral_ix[j] = astral_ix[j-1]; }
+        astral[j] = set[i]; astral_ix[j] = i;
+    }
+    return 1;
+}
+
+static i32 lookup(u32 c) {
+    if (c < BMP) return table[c];
+    ux lo = 0, hi = nastral;
+    while (lo < hi) { ux m = (lo+hi)/2; if (astral[m] < c) lo = m+1; else hi = m; }
+    return lo < nastral && astral[lo] == c ? astral_ix[lo] : -1;
+}
+
+__attribute__((target("avx2")))
+static u64 classify_avx2(const u32 *s, u64 n, i32 *r) {
+    __m256i high = _mm256_set1_epi32(~(BMP-1)), none = _mm256_set1_epi32(-1);
+    u64 i = 0;
+    for (; i+8 <= n; i += 8) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(s+i));
+        if (!_mm256_testz_si256(c, high)) break;
+        __m256i v = _mm256_i32gather_epi32(table, c, 4);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(v, none))) break;
+        _mm256_storeu_si256((__m256i*)(r+i), v);
+    }
+    return i;
+}
+
+i64 tok_classify(const u32 *s, u64 n, const u32 *set, u64 m, i32 *r) {
+    if (!load_set(set, m)) return -1;
+    __builtin_cpu_init();
+    int avx2 = __builtin_cpu_supports("avx2");
+    u64 i = 0;
+    while (i < n) {
+        if (avx2) i += classify_avx2(s+i, n-i, r+i);
+        u64 e = i+8 < n ? i+8 : n;  // a block that stopped the vector loop
+        for (; i < e; i++) if ((r[i] = lookup(s[i])) < 0) return -1-(i64)i;
+    }
+    return n;
+}
+
+/*
+ * Quotes and comments
+ * Scanning forward, the first of # ' " at or after i opens unless it's a
+ * ' without another two places on or a " with no later ", and the search
+ * resumes past its closing: the next newline (or the end) for #, two on
+ * for ', the next " for ".
+ */
+// position of the next character from s[i] that's one of x, y, z, or n
+static u64 find3(const u32 *s, u64 n, u64 i, u32 x, u32 y, u32 z) {
+    __m128i vx = _mm_set1_epi32(x), vy = _mm_set1_epi32(y), vz = _mm_set1_epi32(z);
+    for (; i+4 <= n; i += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(s+i));
+        __m128i e = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(c, vx), _mm_cmpeq_epi32(c, vy)), _mm_cmpeq_epi32(c, vz));
+        int k = _mm_movemask_ps(_mm_castsi128_ps(e));
+        if (k) return i + __builtin_ctz(k);
+    }
+    for (; i < n; i++) if (s[i] == x || s[i] == y || s[i] == z) return i;
+    return n;
+}
+
+void tok_quotes(const u32 *s, u64 n, u8 *a, u8 *b) {
+    memset(a, 0, n); memset(b, 0, n);
+    u64 i = 0;
+    while ((i = find3(s, n, i, '#', '\'', '"')) < n) {
+        u64 e;
+        if (s[i] == '#') {
+            e = find3(s, n, i+1, 10, 13, 10);
+        } else if (s[i] == '\'') {
+            if (i+2 >= n || s[i+2] != '\'') { i++; continue; }
+            e = i+2;
+        } else {
+            e = find3(s, n, i+1, '"', '"', '"');
+            if (e == n) { i++; continue; }
+        }
+        a[i] = 1;
+        if (e < n) b[e] = 1;
+        i = e+1;
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Tokenizer kernels
+ * The two passes of Tokenize in src/c.bqn that touch every source
+ * character, on code point buffers so they can be called through •FFI.
+ * The rest of tokenizing stays in BQN, which is what keeps the results
+ * and error messages identical.
+ */
+
+// r[i] is the index of s[i] in set, as CharCode gives; -1 minus the position of
+// the first character not in set otherwise. The table for the last set is kept.
+i64 tok_classify(const u32 *s, u64 n, const u32 *set, u64 m, i32 *r);
+
+// masks of the comment, character and string openings (a) and closings (b)
+// reached scanning from the start, as Tokenize's reachability search finds them
+void tok_quotes(const u32 *s, u64 n, u8 *a, u8 *b);
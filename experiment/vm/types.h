@@ -1,3 +1,4 @@
+#pragma once
 #include <stdint.h>
 #include <stddef.h>
 
@@ -16,8 +17,33 @@ typedef size_t ux;
 /*
  * Basic types
  */
-typedef struct {
-    data;
-    //TODO
+
+// element types; el_bit arrays are packed 64 per word, least significant bit first
+enum { el_bit, el_i8, el_i16, el_i32, el_f64, el_c8, el_c16, el_c32, el_arr };
+
+typedef struct Arr {
+    u64 refc;
+    u8  type;   // element type
+    u8  rank;
+    u8  mem;    // size class of the allocation, see memory.h
+    ux  ia;     // number of elements
+    ux *sh;     // shape, rank entries
+    void *data; // row-major elements; NULL for a strided view
+    struct Arr *base;  // owner of the data for views, see view.h
+    i64 *st;    // strides in elements for a strided view, else NULL
+    ux  off;    // index of the first element in base
 } Arr;
 
+// bytes per element, 0 for el_bit
+static inline ux el_width(u8 type) {
+    static const u8 w[] = { 0, 1, 2, 4, 8, 1, 2, 4, sizeof(Arr*) };
+    return w[type];
+}
+
+// words needed to hold n packed bits
+static inline ux bit_words(ux n) { return (n+63)/64; }
+
+// size in bytes of the data for n elements of the given type
+static inline ux el_bytes(u8 type, ux n) {
+    return type==el_bit ? 8*bit_words(n) : n*el_width(type);
+}
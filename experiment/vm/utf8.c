@@ -0,0 +1,167 @@
+#include <pthread.h>
+#include <immintrin.h>
+#include "types.h"
+#include "utf8.h"
+
+// decode the sequence at s[i] into *c, returning its length, or 0 if invalid
+static int decode(const u8 *s, u64 n, u64 i, u32 *c) {
+    u8 b = s[i];
+    if (b < 0x80) { *c = b; return 1; }
+    int len; u32 cp;
+    if      (b >= 0xc2 && b < 0xe0) { len = 2; cp = b & 0x1f; }
+    else if (b >= 0xe0 && b < 0xf0) { len = 3; cp = b & 0x0f; }
+    else if (b >= 0xf0 && b < 0xf5) { len = 4; cp = b & 0x07; }
+    else return 0;
+    if (n-i < (u64)len) return 0;
+    for (int k=1; k<len; k++) {
+        u8 t = s[i+k];
+        if ((t & 0xc0) != 0x80) return 0;
+        cp = cp<<6 | (t & 0x3f);
+    }
+    if (len == 3 && (cp < 0x800 || (cp >= 0xd800 && cp < 0xe000))) return 0;
+    if (len == 4 && (cp < 0x10000 || cp > 0x10ffff)) return 0;
+    *c = cp;
+    return len;
+}
+
+/*
+ * ASCII runs
+ * Each returns how far from i the input is ASCII, having copied that much
+ * when r is given, stopping at a block with any high bit set.
+ */
+typedef u64 (*AsciiDec)(const u8 *s, u64 n, u64 i, u32 *r);
+typedef u64 (*AsciiEnc)(const u32 *s, u64 n, u64 i, u8 *r);
+
+static u64 ascii_dec_sse2(const u8 *s, u64 n, u64 i, u32 *r) {
+    u64 i0 = i;
+    __m128i z = _mm_setzero_si128();
+    for (; i+16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s+i));
+        if (_mm_movemask_epi8(v)) break;
+        if (!r) continue;
+        __m128i lo = _mm_unpacklo_epi8(v, z), hi = _mm_unpackhi_epi8(v, z);
+        _mm_storeu_si128((__m128i*)(r+i-i0+ 0), _mm_unpacklo_epi16(lo, z));
+        _mm_storeu_si128((__m128i*)(r+i-i0+ 4), _mm_unpackhi_epi16(lo, z));
+        _mm_storeu_si128((__m128i*)(r+i-i0+ 8), _mm_unpacklo_epi16(hi, z));
+        _mm_storeu_si128((__m128i*)(r+i-i0+12), _mm_unpackhi_epi16(hi, z));
+    }
+    return i-i0;
+}
+
+__attribute__((target("avx2")))
+static u64 ascii_dec_avx2(const u8 *s, u64 n, u64 i, u32 *r) {
+    u64 i0 = i;
+    for (; i+32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s+i));
+        if (_mm256_movemask_epi8(v)) break;
+        if (!r) continue;
+        for (int k=0; k<4; k++) {
+            __m128i b = _mm_loadl_epi64((const __m128i*)(s+i+8*k));
+            _mm256_storeu_si256((__m256i*)(r+i-i0+8*k), _mm256_cvtepu8_epi32(b));
+        }
+    }
+    return (i-i0) + ascii_dec_sse2(s, n, i, r ? r+i-i0 : NULL);
+}
+
+static u64 ascii_enc_sse2(const u32 *s, u64 n, u64 i, u8 *r) {
+    u64 i0 = i;
+    __m128i hi = _mm_set1_epi32(~0x7f);
+    for (; i+8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s+i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s+i+4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(_mm_or_si128(a, b), hi), _mm_setzero_si128())) != 0xffff) break;
+        __m128i w = _mm_packs_epi32(a, b);  // values are below 128, so saturation never applies
+        _mm_storel_epi64((__m128i*)(r+i-i0), _mm_packus_epi16(w, w));
+    }
+    return i-i0;
+}
+
+__attribute__((target("avx2")))
+static u64 ascii_enc_avx2(const u32 *s, u64 n, u64 i, u8 *r) {
+    u64 i0 = i;
+    __m256i hi = _mm256_set1_epi32(~0x7f);
+    for (; i+16 <= n; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s+i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s+i+8));
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), hi)) break;
+        __m256i w = _mm256_packs_epi32(a, b);      // per lane: a0-3 b0-3 | a4-7 b4-7
+        w = _mm256_packus_epi16(w, w);
+        w = _mm256_permutevar8x32_epi32(w, _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0));
+        _mm_storeu_si128((__m128i*)(r+i-i0), _mm256_castsi256_si128(w));
+    }
+    return (i-i0) + ascii_enc_sse2(s, n, i, r+i-i0);
+}
+
+static AsciiDec ascii_dec;
+static AsciiEnc ascii_enc;
+static pthread_once_t selected = PTHREAD_ONCE_INIT;  // callers may be on any thread
+
+static void select_kernels(void) {
+    __builtin_cpu_init();
+    int avx2 = __builtin_cpu_supports("avx2");
+    ascii_dec = avx2 ? ascii_dec_avx2 : ascii_dec_sse2;
+    ascii_enc = avx2 ? ascii_enc_avx2 : ascii_enc_sse2;
+}
+
+/*
+ * Entry points
+ */
+i64 utf8_validate(const u8 *s, u64 n) {
+    pthread_once(&selected, select_kernels);
+    u64 i = 0, c = 0;
+    while (i < n) {
+        u64 a = ascii_dec(s, n, i, NULL);
+        i += a; c += a;
+        if (i == n) break;
+        u32 cp; int l = decode(s, n, i, &cp);
+        if (!l) return -1-(i64)i;
+        i += l; c++;
+    }
+    return c;
+}
+
+i64 utf8_to_utf32(const u8 *s, u64 n, u32 *r) {
+    pthread_once(&selected, select_kernels);
+    u64 i = 0, o = 0;
+    while (i < n) {
+        u64 a = ascii_dec(s, n, i, r+o);
+        i += a; o += a;
+        if (i == n) break;
+        int l = decode(s, n, i, r+o);
+        if (!l) return -1-(i64)i;
+        i += l; o++;
+    }
+    return o;
+}
+
+i64 utf32_to_utf8(const u32 *s, u64 n, u8 *r) {
+    pthread_once(&selected, select_kernels);
+    u64 i = 0, o = 0;
+    while (i < n) {
+        u64 a = ascii_enc(s, n, i, r+o);
+        i += a; o += a;
+        if (i == n) break;
+        u32 c = s[i];
+        if      (c < 0x80)  { r[o++] = c; }
+        else if (c < 0x800) { r[o++] = 0xc0 | c>>6; r[o++] = 0x80 | (c & 0x3f); }
+        else if (c < 0x10000) {
+            if (c >= 0xd800 && c < 0xe000) return -1-(i64)i;
+            r[o++] = 0xe0 | c>>12; r[o++] = 0x80 | (c>>6 & 0x3f); r[o++] = 0x80 | (c & 0x3f);
+        } else if (c < 0x110000) {
+            r[o++] = 0xf0 | c>>18; r[o++] = 0x80 | (c>>12 & 0x3f);
+            r[o++] = 0x80 | (c>>6 & 0x3f); r[o++] = 0x80 | (c & 0x3f);
+        } else return -1-(i64)i;
+        i++;
+    }
+    return o;
+}
+
+u64 utf8_complete(const u8 *s, u64 n) {
+    for (u64 k=1; k<=3 && k<=n; k++) {
+        u8 b = s[n-k];
+        if ((b & 0xc0) == 0x80) continue;  // continuation byte, keep looking for the lead
+        u64 len = b < 0xc0 ? 1 : b < 0xe0 ? 2 : b < 0xf0 ? 3 : 4;
+        return len > k ? n-k : n;
+    }
+    return n;
+}
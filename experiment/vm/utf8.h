@@ -0,0 +1,16 @@
+#pragma once
+#include "types.h"
+
+/*
+ * UTF-8 transcoding
+ * These work on plain buffers so the BQN side can call them through •FFI
+ * (see src/utf.bqn and make lib). Runs of ASCII go through SSE2 or AVX2,
+ * other sequences through a scalar decoder that rejects overlong forms,
+ * surrogates and code points past U+10FFFF. On invalid input the result
+ * is -1 minus the position of the offending byte or code point.
+ */
+
+i64 utf8_validate(const u8 *s, u64 n);                // number of code points
+i64 utf8_to_utf32(const u8 *s, u64 n, u32 *r);        // r needs room for n; code points written
+i64 utf32_to_utf8(const u32 *s, u64 n, u8 *r);        // r needs room for 4*n; bytes written
+u64 utf8_complete(const u8 *s, u64 n);  // length without a trailing truncated sequence, for chunked reads
@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "memory.h"
+#include "view.h"
+
+// strides and offset of x relative to its base (or itself)
+static void layout(Arr *x, i64 *st, ux *off) {
+    if (x->st) memcpy(st, x->st, x->rank*sizeof(i64));
+    else for (i64 s=1, i=x->rank; i--; ) { st[i] = s; s *= x->sh[i]; }
+    *off = x->base ? x->off : 0;
+}
+
+static int row_major(Arr *x) {
+    if (!x->st) return 1;
+    for (i64 s=1, i=x->rank; i--; ) {
+        if (x->sh[i]!=1 && x->st[i]!=s) return 0;
+        s *= x->sh[i];
+    }
+    return 1;
+}
+
+static Arr *view_new(Arr *x, u8 rank, const ux *sh, const i64 *st, ux off) {
+    Arr *b = x->base ? x->base : x;
+    ux size = sizeof(Arr) + rank*(sizeof(ux)+sizeof(i64));
+    u8 cls = mem_class(size);
+    Arr *r = mem_alloc(cls, size);
+    r->refc = 1; r->type = x->type; r->rank = rank; r->mem = cls;
+    r->sh = (ux*)(r+1);
+    r->st = (i64*)(r->sh + rank);
+    memcpy(r->sh, sh, rank*sizeof(ux));
+    memcpy(r->st, st, rank*sizeof(i64));
+    r->ia = 1;
+    for (ux i=0; i<rank; i++) r->ia *= sh[i];
+    r->base = ptr_inc(b); r->off = off; r->data = NULL;
+    return r;
+}
+
+// copy the elements of strided view x into d, row-major
+static void gather(Arr *x, void *d) {
+    ux k = x->rank, n = x->ia;
+    if (!n) return;
+    ux *j = calloc(k+1, sizeof(ux));
+    i64 p = x->off;
+    ux w = el_width(x->type);
+    u8 *s = x->base->data, *o = d;
+    u64 *sb = x->base->data, *ob = d;
+    if (x->type==el_bit) for (ux i=0; i<bit_words(n); i++) ob[i] = 0;
+    for (ux i=0; i<n; i++) {
+        if (x->type==el_bit) ob[i/64] |= (sb[p/64]>>(p%64) & 1) << (i%64);
+        else memcpy(o + i*w, s + p*w, w);
+        // step the multi-index and position, last axis fastest
+        for (ux a=k; a--; ) {
+            p += x->st[a];
+            if (++j[a] < x->sh[a]) break;
+            p -= (i64)x->sh[a]*x->st[a];
+            j[a] = 0;
+        }
+    }
+    free(j);
+}
+
+// new array with the elements of view x
+static Arr *copy(Arr *x) {
+    Arr *c = arr_new(x->type, x->rank, x->sh);
+    if (x->st) gather(x, c->data);
+    else memcpy(c->data, x->data, el_bytes(x->type, x->ia));
+    if (x->type==el_arr) for (ux i=0; i<c->ia; i++) ptr_inc(((Arr**)c->data)[i]);
+    return c;
+}
+
+Arr *arr_flat(Arr *x) {
+    if (!x->st) return ptr_inc(x);
+    Arr *b = x->base;
+    if (row_major(x) && (x->type!=el_bit || (x->off==0 && x->ia==b->ia))) {
+        Arr *r = view_new(x, x->rank, x->sh, x->st, x->off);
+        r->data = (u8*)b->data + x->off*el_width(x->type);
+        r->st = NULL;  // the inline strides are simply unused
+        return r;
+    }
+    return copy(x);
+}
+
+void arr_own(Arr *x) {
+    Arr *b = x->base;
+    if (!b) return;
+    Arr *c = copy(x);
+    ptr_dec(b);
+    x->base = c; x->off = 0; x->data = c->data; x->st = NULL;
+}
+
+/*
+ * Structural functions
+ */
+#define LAYOUT(x) \
+    i64 *st = malloc(((x)->rank+1)*sizeof(i64)); ux *sh = malloc(((x)->rank+1)*sizeof(ux)); ux off; \
+    layout(x, st, &off); memcpy(sh, (x)->sh, (x)->rank*sizeof(ux));
+#define RETURN_VIEW(x, rank) { Arr *r = view_new(x, rank, sh, st, off); free(st); free(sh); return r; }
+
+Arr *view_transpose(Arr *x) {
+    if (x->rank < 2) return ptr_inc(x);
+    LAYOUT(x)
+    ux s0 = sh[0]; i64 t0 = st[0];
+    memmove(sh, sh+1, (x->rank-1)*sizeof(ux)); sh[x->rank-1] = s0;
+    memmove(st, st+1, (x->rank-1)*sizeof(i64)); st[x->rank-1] = t0;
+    RETURN_VIEW(x, x->rank)
+}
+
+Arr *view_reverse(Arr *x) {
+    if (!x->rank) return NULL;
+    LAYOUT(x)
+    if (sh[0]) off += (sh[0]-1)*st[0];
+    st[0] = -st[0];
+    RETURN_VIEW(x, x->rank)
+}
+
+/*
+ * Overtaking
+ * Fills are 0 for numbers and space for characters. A nested array's
+ * fill comes from its first element: that element's shape, filled in
+ * turn, or the atom fill for a rank 0 element.
+ */
+// write fills to elements [i0,i1) of flat r
+static void fill_flat(Arr *r, ux i0, ux i1) {
+    for (ux i=i0; i<i1; i++) switch (r->type) {
+        case el_bit: ((u64*)r->data)[i/64] &= ~((u64)1<<(i%64)); break;
+        case el_c8:  ((u8 *)r->data)[i] = ' '; break;
+        case el_c16: ((u16*)r->data)[i] = ' '; break;
+        case el_c32: ((u32*)r->data)[i] = ' '; break;
+        default: { ux w = el_width(r->type); memset((u8*)r->data + i*w, 0, w); }
+    }
+}
+
+// the fill of nested elements, given the first, as a new array
+static Arr *fill_of(Arr *e) {
+    Arr *r = arr_new(e->type, e->rank, e->sh);
+    if (e->type!=el_arr) { fill_flat(r, 0, r->ia); return r; }
+    if (!r->ia) return r;
+    Arr *f = arr_flat(e), *ef = fill_of(((Arr**)f->data)[0]);
+    for (ux i=0; i<r->ia; i++) ((Arr**)r->data)[i] = ptr_inc(ef);
+    ptr_dec(ef); ptr_dec(f);
+    return r;
+}
+
+// n↑x with |n| past ≠x
+static Arr *overtake(Arr *x, i64 n) {
+    ux len = x->sh[0], m = n<0 ? -n : n;
+    ux *sh = malloc(x->rank*sizeof(ux));
+    memcpy(sh, x->sh, x->rank*sizeof(ux));
+    sh[0] = m;
+    Arr *r = arr_new(x->type, x->rank, sh);
+    free(sh);
+    ux cell = len ? x->ia/len : 1;
+    for (ux a=1; !len && a<x->rank; a++) cell *= x->sh[a];
+    ux k = x->ia, o = n<0 ? (m-len)*cell : 0;  // elements copied, and where they go
+    Arr *f = arr_flat(x);
+    if (x->type==el_bit) {
+        u64 *fp = f->data, *rp = r->data;
+        for (ux i=0; i<bit_words(r->ia); i++) rp[i] = 0;
+        for (ux i=0; i<k; i++) rp[(o+i)/64] |= (fp[i/64]>>(i%64) & 1) << ((o+i)%64);
+    } else if (x->type==el_arr) {
+        Arr **rp = r->data, **fp = f->data;
+        Arr *fill = k ? fill_of(fp[0]) : arr_new(el_i32, 0, NULL);  // an empty array's is taken as 0
+        if (!k) *(i32*)fill->data = 0;
+        for (ux i=0; i<r->ia; i++) rp[i] = ptr_inc(i>=o && i<o+k ? fp[i-o] : fill);
+        ptr_dec(fill);
+    } else {
+        fill_flat(r, 0, o);
+        memcpy((u8*)r->data + o*el_width(x->type), f->data, k*el_width(x->type));
+        fill_flat(r, o+k, r->ia);
+    }
+    ptr_dec(f);
+    return r;
+}
+
+Arr *view_take(Arr *x, i64 n) {
+    if (!x->rank) return NULL;
+    if ((ux)(n<0 ? -n : n) > x->sh[0]) return overtake(x, n);
+    LAYOUT(x)
+    if (n<0) { off += (sh[0]+n)*st[0]; n = -n; }
+    sh[0] = n;
+    RETURN_VIEW(x, x->rank)
+}
+
+Arr *view_drop(Arr *x, i64 n) {
+    if (!x->rank) return NULL;
+    i64 len = x->sh[0], k = (n<0 ? -n : n) > len ? 0 : len - (n<0 ? -n : n);
+    return view_take(x, n<0 ? k : -k);
+}
+
+Arr *view_cell(Arr *x, ux i) {
+    LAYOUT(x)
+    off += i*st[0];
+    Arr *r = view_new(x, x->rank-1, sh+1, st+1, off);
+    free(st); free(sh);
+    return r;
+}
+
+Arr *view_reshape(Arr *x, u8 rank, const ux *sh) {
+    ux ia = 1;
+    for (ux i=0; i<rank; i++) ia *= sh[i];
+    if (ia != x->ia) return NULL;
+    Arr *f = !row_major(x) || (x->st && x->type==el_bit) ? arr_flat(x) : ptr_inc(x);
+    i64 *st = malloc((rank+1)*sizeof(i64));
+    for (i64 s=1, i=rank; i--; ) { st[i] = s; s *= sh[i]; }
+    Arr *r = view_new(f, rank, sh, st, f->base ? f->off : 0);
+    free(st);
+    ptr_dec(f);
+    return r;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "types.h"
+
+/*
+ * Views
+ * A view shares the data of base, which is never itself a view. Element
+ * j (a multi-index) of a strided view is element off+Σj×st of base; a
+ * flat view instead points data into base's data.
+ * Kernels read data through arr_flat, which gives a flat view in place of
+ * a row-major strided one and a copy otherwise. It never modifies its
+ * argument, so pool workers can share one. Anything writing to data in
+ * place calls arr_own on an array it holds the only reference to.
+ * The structural functions borrow x and return a new view, or NULL where
+ * a view can't express the result.
+ */
+
+Arr *view_transpose(Arr *x);   // ⍉x
+Arr *view_reverse(Arr *x);     // ⌽x
+Arr *view_take(Arr *x, i64 n); // n↑x, a copy padded with fills if |n| is more than ≠x
+Arr *view_drop(Arr *x, i64 n); // n↓x
+Arr *view_reshape(Arr *x, u8 rank, const ux *sh);  // sh⥊x, NULL unless ×´sh is ≠⥊x
+Arr *view_cell(Arr *x, ux i);  // i⊏x, x must have rank 1 or more
+
+Arr *arr_flat(Arr *x);  // borrows x, returns a new reference to x or a flat version of it
+void arr_own(Arr *x);